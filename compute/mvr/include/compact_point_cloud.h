@@ -0,0 +1,53 @@
+#pragma once
+#ifndef COMPACT_POINT_CLOUD_H_
+#define COMPACT_POINT_CLOUD_H_
+
+#include <vector>
+#include <stdint.h>
+
+#include "types.h"
+
+// A cloud in 12 bytes per point instead of the 48 of PCLRichPoint, for the clouds that are cached
+// but not in use: the position in 16 bit fixed point over the bounding box of the cloud, 8 bit color
+// and the normal in 2 bytes on an octahedron. The position error is at most half of extent/65534
+// per axis and the normal error about a degree, curvature and alpha are not kept.
+class CompactPointCloud
+{
+public:
+  CompactPointCloud(void);
+  ~CompactPointCloud(void);
+
+  void encode(const PCLRichPointCloud& point_cloud);
+  void decode(PCLRichPointCloud& point_cloud) const;
+
+  inline size_t size(void) const {return points_.size();}
+  inline size_t getMemorySize(void) const {return points_.capacity()*sizeof(CompactPoint);}
+
+  // the points of [begin, end), encode and decode run blocks of points in parallel
+  void encode(const PCLRichPointCloud& point_cloud, size_t begin, size_t end);
+  void decode(PCLRichPointCloud& point_cloud, size_t begin, size_t end) const;
+
+private:
+  enum Flag
+  {
+    NON_FINITE_POSITION = 1,
+    ZERO_NORMAL = 2
+  };
+
+  struct CompactPoint
+  {
+    int16_t   x, y, z;
+    uint8_t   r, g, b;
+    uint8_t   normal_u, normal_v;
+    uint8_t   flags;
+  };
+
+  std::vector<CompactPoint> points_;
+  float                     center_[3];
+  float                     step_[3];
+  uint32_t                  width_;
+  uint32_t                  height_;
+  bool                      is_dense_;
+};
+
+#endif /*COMPACT_POINT_CLOUD_H_*/
@@ -0,0 +1,28 @@
+#pragma once
+#ifndef CONNECTED_COMPONENTS_H_
+#define CONNECTED_COMPONENTS_H_
+
+#include <vector>
+
+#include "types.h"
+
+// The connected components of the graph that links the points of a cloud closer than a distance.
+// The points are sorted into cubic cells with a diagonal of that distance, so the points of a cell
+// are all linked and only cells a few apart have to be compared. The cells are merged by a lock free
+// union-find from several threads, and the result does not depend on their order.
+class ConnectedComponents
+{
+public:
+  ConnectedComponents(const PCLRichPointCloud& point_cloud, double distance);
+  ~ConnectedComponents(void);
+
+  // the component of every point, numbered in the order of their first points, and the points
+  // in every component, return the number of components, non finite points are alone in theirs
+  size_t compute(std::vector<int>& components, std::vector<size_t>& component_sizes) const;
+
+private:
+  const PCLRichPointCloud&  point_cloud_;
+  double                    distance_;
+};
+
+#endif /*CONNECTED_COMPONENTS_H_*/
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef CROP_ENGINE_H_
+#define CROP_ENGINE_H_
+
+#include <vector>
+
+#include <osg/Vec3>
+#include <osg/Vec4>
+
+#include "types.h"
+
+// A list of regions cut away from a cloud, all tested in one pass: a point is cropped
+// if it is on the negative side of a half-space, inside a sphere or inside a box.
+// The coordinates of a tile of points are gathered into arrays and every region is tested on them
+// four points at a time, the blocks of tiles run in parallel.
+class CropEngine
+{
+public:
+  CropEngine(void);
+  ~CropEngine(void);
+
+  // crops a*x+b*y+c*z+d <= 0, with plane = (a, b, c, d)
+  void addHalfSpace(const osg::Vec4& plane);
+  void addSphere(const osg::Vec3& center, double radius);
+  void addBox(const osg::Vec3& min, const osg::Vec3& max);
+
+  void clear(void);
+  inline bool empty(void) const {return half_spaces_.empty() && spheres_.empty() && boxes_.empty();}
+
+  // flags[i] is set to 1 for the cropped points and 0 for the others, returns the number cropped
+  size_t evaluate(const PCLRichPointCloud& point_cloud, std::vector<unsigned char>& flags) const;
+  // the points of [begin, end), evaluate runs blocks of points in parallel
+  void evaluate(const PCLRichPointCloud& point_cloud, size_t begin, size_t end, unsigned char* flags) const;
+
+private:
+  struct Sphere
+  {
+    osg::Vec3 center;
+    double    squared_radius;
+  };
+
+  struct Box
+  {
+    osg::Vec3 min;
+    osg::Vec3 max;
+  };
+
+  std::vector<osg::Vec4d> half_spaces_;
+  std::vector<Sphere>     spheres_;
+  std::vector<Box>        boxes_;
+};
+
+#endif /*CROP_ENGINE_H_*/
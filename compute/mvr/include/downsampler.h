@@ -0,0 +1,38 @@
+#pragma once
+#ifndef DOWNSAMPLER_H_
+#define DOWNSAMPLER_H_
+
+#include <vector>
+
+#include "types.h"
+
+// Deterministic downsampling, the same cloud always gives the same points.
+// The voxel grid keeps one point per occupied voxel, the mean of the points in it, the Poisson disk
+// keeps points of the cloud at least a radius apart, so both spread the points evenly over the
+// surface instead of following the scan density. For a point budget the voxel size or the radius
+// is searched so that the result has at most, and close to, that many points.
+class Downsampler
+{
+public:
+  Downsampler(const PCLRichPointCloud& point_cloud);
+  ~Downsampler(void);
+
+  void voxelGrid(double voxel_size, PCLRichPointCloud& downsampled) const;
+  void poissonDisk(double radius, PCLRichPointCloud& downsampled) const;
+
+  // return the voxel size or the radius used, 0 if the cloud is within the budget and copied as is
+  double voxelGridToBudget(size_t point_budget, PCLRichPointCloud& downsampled) const;
+  double poissonDiskToBudget(size_t point_budget, PCLRichPointCloud& downsampled) const;
+
+private:
+  double searchToBudget(size_t point_budget, bool poisson_disk, PCLRichPointCloud& downsampled) const;
+  // the finite points in a fixed pseudo random order
+  void getPoissonDiskOrder(std::vector<size_t>& order) const;
+  void poissonDisk(double radius, const std::vector<size_t>& order, PCLRichPointCloud& downsampled) const;
+
+  const PCLRichPointCloud&  point_cloud_;
+  float                     min_[3];
+  float                     max_[3];
+};
+
+#endif /*DOWNSAMPLER_H_*/
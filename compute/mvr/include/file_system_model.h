@@ -2,11 +2,15 @@
 #ifndef FILE_SYSTEM_MODEL_H
 #define FILE_SYSTEM_MODEL_H
 
+#include <memory>
 #include <unordered_map>
 
 #include <QSet>
 #include <QHash>
 #include <QMutex>
+#include <QFuture>
+#include <QDateTime>
+#include <QFutureWatcher>
 #include <QFileSystemModel>
 #include <QPersistentModelIndex>
 
@@ -14,6 +18,8 @@
 #include <osg/Vec4>
 
 class PointCloud;
+class CompactPointCloud;
+class QFutureInterfaceBase;
 
 class FileSystemModel : public QFileSystemModel
 {
@@ -31,6 +37,11 @@ public:
   bool isShown(const std::string& filename) const;
 
   osg::ref_ptr<PointCloud> getPointCloud(const std::string& filename);
+  // the model is only locked around the caches, future gets the progress of the read if not NULL
+  osg::ref_ptr<PointCloud> getPointCloud(const std::string& filename, QFutureInterfaceBase* future);
+  // finished at once for a cached cloud, else the file is opened on the thread pool, the progress is
+  // in percent and canceling stops the read, the result is NULL if the cloud could not be opened
+  QFuture<osg::ref_ptr<PointCloud> > getPointCloudAsync(const std::string& filename);
   osg::ref_ptr<PointCloud> getPointCloud(int frame);   
   osg::ref_ptr<PointCloud> getPointCloud(int frame, int view);
   void getFrameRange(int &start, int &end);
@@ -73,6 +84,10 @@ public:
     void showPointCloud(int frame, int view);
     void hideAndShowPointCloud(int hide_frame, int hide_view, int show_frame, int show_view);
 
+  private slots:
+    void updateLoadingProgress(void);
+    void finishLoading(void);
+
 signals:
     void progressValueChanged(int value);
     void timeToHideAndShowPointCloud(int hide_frame, int hide_view, int show_frame, int show_view);
@@ -85,10 +100,12 @@ private:
   
   
   void showPointCloud(const QPersistentModelIndex& index);
+  void addPointCloud(const QPersistentModelIndex& index, osg::ref_ptr<PointCloud> point_cloud);
   void hidePointCloud(const QPersistentModelIndex& index);
   void showPointCloudSceneInformation(void) const;
   
   
+  // takes the lock itself, the freeable clouds are encoded without it
   void limitPointCloudCacheSize(void);
 
   void getDisplayFirstFrameFirstView(int& frame, int& view);
@@ -104,9 +121,31 @@ private:
   typedef QHash<QPersistentModelIndex, osg::ref_ptr<PointCloud> > PointCloudMap;
   typedef std::unordered_map<std::string, osg::ref_ptr<PointCloud> > PointCloudCacheMap;
 
+  // clouds dropped from the cache are kept compact, at a quarter of the memory, until their file changes
+  struct CompactCacheEntry
+  {
+    std::shared_ptr<CompactPointCloud>  points;
+    QDateTime                           last_modified;
+    qint64                              file_size;
+    size_t                              memory_size;
+    size_t                              age;
+  };
+  typedef std::unordered_map<std::string, CompactCacheEntry> CompactCacheMap;
+
+  // with the lock held, evicts the oldest entries past the memory budget
+  void addCompactPointCloud(const std::string& filename, const CompactCacheEntry& entry);
+
+  // checked clouds still being opened, shown with their progress in the tree until they are added
+  typedef QFutureWatcher<osg::ref_ptr<PointCloud> > LoadingWatcher;
+  typedef QHash<QPersistentModelIndex, LoadingWatcher*> LoadingWatcherMap;
+
   QSet<QPersistentModelIndex>     checked_indexes_;
   PointCloudMap                   point_cloud_map_;
   PointCloudCacheMap              point_cloud_cache_map_;
+  CompactCacheMap                 compact_cache_map_;
+  LoadingWatcherMap               loading_watchers_;
+  size_t                          compact_cache_age_;
+  size_t                          compact_cache_size_;
   int                             start_frame_;
   int                             end_frame_;
   int							  view_number_;
@@ -0,0 +1,29 @@
+#pragma once
+#ifndef GRID_NORMAL_ESTIMATOR_H_
+#define GRID_NORMAL_ESTIMATOR_H_
+
+#include "types.h"
+
+class ImageGrid;
+
+// Surface normals of a view cloud from its image grid: the covariance of the points in a
+// (2*radius+1)^2 pixel window, kept as running sums while the window slides over the image,
+// so the cost does not depend on the radius and no kd-tree is needed.
+class GridNormalEstimator
+{
+public:
+  GridNormalEstimator(const ImageGrid& image_grid, int radius);
+  ~GridNormalEstimator(void);
+
+  // normals point to the camera at the origin, points with less than 3 neighbors get the view direction
+  void compute(PCLRichPointCloud& point_cloud) const;
+
+  // the rows [row_begin, row_end) of the image, compute runs bands of rows in parallel
+  void computeRows(int row_begin, int row_end, PCLRichPointCloud& point_cloud) const;
+
+private:
+  const ImageGrid&  image_grid_;
+  int               radius_;
+};
+
+#endif /*GRID_NORMAL_ESTIMATOR_H_*/
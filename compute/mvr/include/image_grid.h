@@ -0,0 +1,53 @@
+#pragma once
+#ifndef IMAGE_GRID_H_
+#define IMAGE_GRID_H_
+
+#include <string>
+#include <vector>
+
+// Maps the camera pixels of a view to the indices of the points decoded from them,
+// so image neighborhoods are found in O(1) instead of with a kd-tree.
+// It is kept next to points.pcd as points.grid, one pixel index per point.
+class ImageGrid
+{
+public:
+  ImageGrid(void);
+  ImageGrid(int width, int height, size_t point_number);
+  ~ImageGrid(void);
+
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  inline int getWidth(void) const {return width_;}
+  inline int getHeight(void) const {return height_;}
+  inline size_t getPointNumber(void) const {return pixels_.size();}
+
+  // the point decoded from pixel (x, y), -1 if there is none
+  inline int getPoint(int x, int y) const
+  {
+    return (x >= 0 && x < width_ && y >= 0 && y < height_)?(grid_[y*width_+x]):(-1);
+  }
+  inline int getX(size_t point) const {return pixels_[point]%width_;}
+  inline int getY(size_t point) const {return pixels_[point]/width_;}
+
+  // the first point set for a pixel keeps it
+  void setPixel(size_t point, int x, int y);
+
+  // points in the (2*radius+1)^2 pixel window around point, without the point itself
+  void getNeighbors(size_t point, int radius, std::vector<int>& neighbors) const;
+
+  // drop the points where keep is 0 and renumber the others, like a stable compaction of the cloud
+  void compact(const std::vector<unsigned char>& keep);
+
+private:
+  void buildGrid(void);
+
+  int               width_;
+  int               height_;
+  // pixel index y*width+x of every point
+  std::vector<int>  pixels_;
+  // point index of every pixel, -1 if none
+  std::vector<int>  grid_;
+};
+
+#endif /*IMAGE_GRID_H_*/
@@ -0,0 +1,53 @@
+#pragma once
+#ifndef NEIGHBOR_GRAPH_H_
+#define NEIGHBOR_GRAPH_H_
+
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+
+#include "types.h"
+#include "search_backend.h"
+
+// The neighbors of every point of a cloud in compressed sparse rows, closest first.
+// The rows are sorted by distance, so a graph of the k nearest neighbors also answers for
+// a smaller k and one of a radius for a smaller radius, with the first entries of the rows.
+class NeighborGraph
+{
+public:
+  typedef boost::shared_ptr<const NeighborGraph> ConstPtr;
+
+  enum Type
+  {
+    K_NEAREST,
+    RADIUS
+  };
+
+  // size is k for K_NEAREST and the radius for RADIUS
+  static ConstPtr build(const SearchBackend<PCLRichPoint>& search, Type type, double size);
+
+  inline Type getType(void) const {return type_;}
+  inline double getSize(void) const {return size_;}
+  bool covers(Type type, double size) const;
+
+  inline size_t getPointNumber(void) const {return offsets_.size()-1;}
+  inline size_t getEdgeNumber(void) const {return neighbors_.size();}
+
+  inline size_t getDegree(size_t i) const {return offsets_[i+1]-offsets_[i];}
+  inline const int* getNeighbors(size_t i) const {return neighbors_.data()+offsets_[i];}
+  inline const float* getSquaredDistances(size_t i) const {return squared_distances_.data()+offsets_[i];}
+  // the leading entries of row i within k neighbors or within radius
+  size_t getKNearestNumber(size_t i, int k) const;
+  size_t getRadiusNumber(size_t i, double radius) const;
+
+private:
+  NeighborGraph(Type type, double size);
+
+  Type                type_;
+  double              size_;
+  std::vector<size_t> offsets_;
+  std::vector<int>    neighbors_;
+  std::vector<float>  squared_distances_;
+};
+
+#endif /*NEIGHBOR_GRAPH_H_*/
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef OVERLAP_FILTER_H_
+#define OVERLAP_FILTER_H_
+
+#include <unordered_set>
+
+#include <stdint.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include "types.h"
+
+// The cells of a grid over a cloud that are within a distance of its points, the occupied cells
+// dilated by one ring of cells at least that distance wide. A point outside of them is farther
+// than the distance from every point of the cloud, so it can be dropped before the nearest neighbor
+// queries of the correspondences, which between neighboring views of the turntable only overlap
+// in a sector. A point inside may still be farther, the filter never drops a close one.
+// As it is exact up to the cells, it can not skip more queries than the part of the views that
+// does not overlap, about a sixth for views that see half of the table each 30 degrees apart.
+class OverlapFilter
+{
+public:
+  typedef boost::shared_ptr<const OverlapFilter> ConstPtr;
+
+  OverlapFilter(const PCLPointCloud& cloud, double distance);
+  // with the rotation axis of the turntable in the frame of the cloud, the sector of the cloud around
+  // the axis widened by the distance is tested first, two dot products that reject the points of the
+  // other views before the cells are looked up. Any axis keeps the filter exact, the calibrated one
+  // makes the sector narrowest, and there is none if the cloud spans half a turn or more
+  OverlapFilter(const PCLPointCloud& cloud, double distance, const Eigen::Vector3f& pivot_point,
+    const Eigen::Vector3f& axis_normal);
+  ~OverlapFilter(void);
+
+  inline double getDistance(void) const {return distance_;}
+
+  bool contains(const PCLPoint& point) const;
+  // the points of cloud that may be within the distance
+  void filter(const PCLPointCloud& cloud, PCLPointCloud& filtered_cloud) const;
+
+private:
+  void buildCells(const PCLPointCloud& cloud, double distance);
+  void buildSector(const PCLPointCloud& cloud, const Eigen::Vector3f& pivot_point, const Eigen::Vector3f& axis_normal);
+  bool getKey(float x, float y, float z, uint64_t& key) const;
+
+  double                        distance_;
+  // the planes through the axis that bound the sector, normal*point+offset >= 0 inside
+  bool                          has_sector_;
+  float                         sector_normals_[2][3];
+  float                         sector_offsets_[2];
+  double                        cell_size_;
+  float                         min_[3];
+  int64_t                       dimensions_[3];
+  std::unordered_set<uint64_t>  cells_;
+};
+
+#endif /*OVERLAP_FILTER_H_*/
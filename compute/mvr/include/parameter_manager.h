@@ -21,14 +21,16 @@ public:
 
 
   double getRegistrationMaxDistance(void) const;
+  bool getGridSearch(void) const;
   double getTriangleLength(void) const;
 
   bool getFrameParameter(int& frame);
   bool getFrameParameters(int& start_frame, int& end_frame, int& downsampling);
 
-  bool getGenerationParameters(int& ctr_threshold, int& sat_threshold);
-  bool getGenerationParameters(int& ctr_threshold, int& sat_threshold,
-	  int& start_frame, int& end_frame, bool with_frames=true);
+  bool getGenerationParameters(int& ctr_threshold, int& sat_threshold, bool& bilinear_color, bool& fused_generation,
+	  bool& keep_decode_maps, int& normal_radius);
+  bool getGenerationParameters(int& ctr_threshold, int& sat_threshold, bool& bilinear_color, bool& fused_generation,
+	  bool& keep_decode_maps, int& normal_radius, int& start_frame, int& end_frame, bool with_frames=true);
 
   bool getRegistrationLUMParameters(int& segment_threshold, int& max_iterations, double& max_distance);
   bool getRegistrationLUMParameters(int& segment_threshold, int& max_iterations, double& max_distance,
@@ -37,11 +39,14 @@ public:
   bool getRegistrationICPParameters(int& max_iterations, double& max_distance, int& frame, int& repeat_times);
   bool getRegistrationParameters(int& frame, int& segment_threshold);
   
-  bool getDenoiseParameters(int& segment_threshold, int& start_frame, int& end_frame, bool with_frames=true);
+  bool getDenoiseParameters(int& segment_threshold, double& triangle_length, bool& component_denoise,
+    int& start_frame, int& end_frame, bool with_frames=true);
   bool getDataCutParameters(int& start_frame, int& end_frame, bool with_frames=true);
   bool getRemoveOutliersParameters(int& start_frame, int& end_frame, bool with_frames=true);
+  bool getCropParameters(bool& by_plane, bool& by_sphere, int& start_frame, int& end_frame, bool with_frames=true);
   bool getExtractImagesParameters(int& view_number, int& start_frame, int& end_frame, bool with_frames=true);
-  bool getDownsamplingParameters(int& sample_ratio, int& start_frame, int& end_frame, bool with_frames=true);
+  bool getDownsamplingParameters(int& sample_ratio, int& point_budget, bool& poisson_disk,
+    int& start_frame, int& end_frame, bool with_frames=true);
   bool getExtractPointsParameters(int& interval, int& start_frame, int& end_frame, bool with_frames=true);
 
 protected:
@@ -55,6 +60,7 @@ private:
 
   IntParameter*                                       registration_max_iterations_;
   DoubleParameter*                                    registration_max_distance_;
+  BoolParameter*                                      grid_search_;
 
   IntParameter*                                       start_frame_;
   IntParameter*                                       end_frame_;
@@ -64,8 +70,11 @@ private:
 
   DoubleParameter*                                    triangle_length_;
   IntParameter*                                       segment_threshold_;
+  BoolParameter*                                      component_denoise_;
   IntParameter*										  view_number_;
   IntParameter*										  sample_ratio_;
+  IntParameter*										  point_budget_;
+  BoolParameter*									  poisson_disk_;
   IntParameter*										  interval_;
 
   DoubleParameter*                                    transformation_epsilon_;
@@ -73,6 +82,13 @@ private:
 
   IntParameter*                                       generator_ctr_threshold_;
   IntParameter*                                       generator_sat_threshold_;
+  BoolParameter*                                      generator_bilinear_color_;
+  BoolParameter*                                      generator_fused_generation_;
+  BoolParameter*                                      generator_keep_decode_maps_;
+  IntParameter*                                       generator_normal_radius_;
+
+  BoolParameter*                                      crop_by_plane_;
+  BoolParameter*                                      crop_by_sphere_;
 
 };
 
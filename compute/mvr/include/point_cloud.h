@@ -12,6 +12,8 @@
 
 #include "Renderable.h"
 #include "types.h"
+#include "image_grid.h"
+#include "neighbor_graph.h"
 
 namespace osgManipulator
 {
@@ -20,6 +22,10 @@ namespace osgManipulator
 }
 
 
+class CropEngine;
+class CompactPointCloud;
+class QFutureInterfaceBase;
+
 class PointCloud : public QObject, public Renderable, public PCLRichPointCloud
 {
   Q_OBJECT
@@ -30,26 +36,49 @@ public:
 
   virtual const char* className() const {return "PointCloud";}
 
-  bool open(const std::string& filename);
+  // the file is read without the lock, a future gets the progress of the read and may cancel it
+  bool open(const std::string& filename, QFutureInterfaceBase* future=NULL);
+  // the points from a compact copy instead of the file, the rest is still read from the files
+  bool open(const std::string& filename, const CompactPointCloud& compact_points);
   bool save(const std::string& filename);
   void reload(void);
+  // the points of a compact copy are quantized, they are read from the file again before anything is saved
+  // from them, the noise marks and the pose are kept, false if the file does not fit the points anymore
+  bool restoreExactPoints(void);
 
   inline const std::string& getFilename(void) const {return filename_;}
-
+  // pixel to point mapping of the view, NULL if the cloud was not generated with one or has been changed since
+  inline const ImageGrid* getImageGrid(void) const
+  {
+    return (!empty() && image_grid_.getPointNumber() == size())?(&image_grid_):(NULL);
+  }
+
+  // the points under the current matrix, cached until the points or the matrix change
+  PCLPointCloud::ConstPtr getTransformedPoints(void);
   void getTransformedPoints(PCLPointCloud& points);
+  // the points without the matrix, a copy that does not change when the pose does
+  PCLPointCloud::ConstPtr getLocalPoints(void);
+
+  // neighborhoods shared by the processing stages, built once with the search backend
+  // of the Grid Search parameter and kept until the points change
+  NeighborGraph::ConstPtr getKNearestGraph(int k);
+  NeighborGraph::ConstPtr getRadiusGraph(double radius);
 
   inline bool isRegistered(void) const {return registered_;}
   void setRegisterState(bool registered);
 
   void registration(int segment_threshold, int max_iterations, double max_distance);
 
+  // noise is only marked, removeNoise drops the marked points and saves the cloud
   void indicateNoise(size_t i);
-  bool isNoise(size_t i);
+  bool isNoise(size_t i) const;
   void denoise(int segment_threshold, double triangle_length);
   void denoise(int k);
   void removeNoise(void);
   void extractByPlane(void);
   void extractBySphere(void);
+  // marks the points cropped by crop_engine as noise, stage names them in the report
+  void crop(const CropEngine& crop_engine, const std::string& stage);
 
   int getFrame(void) const;
   int getView(void) const;
@@ -71,9 +100,6 @@ protected:
 
   PointCloud* getPrevFrame(void);
   PointCloud* getNextFrame(void);
-  
-  void initPointGraph(double distance_threshold);
-  void triangulate(void) const;
 
   void loadTransformation(void);
   void saveTransformation(void);
@@ -81,15 +107,22 @@ protected:
 
   void visualizePoints(size_t start, size_t end);
 
+  // with mutex_ held
+  const SearchBackend<PCLRichPoint>& getSearch(void);
+  NeighborGraph::ConstPtr getNeighborGraph(NeighborGraph::Type type, double size);
+
 protected:
   std::string                     filename_;
+  ImageGrid                       image_grid_;
   size_t                          points_num_;
   size_t                          noise_points_num_;
+  // one bit per point, empty when nothing is marked
+  std::vector<bool>               noise_mask_;
   osg::Vec4                       color_;
-
-  boost::PointGraph*              point_graph_;
-  double                          point_graph_threshold_;
- // mutable CGAL::Delaunay*         triangulation_;
+  // bumped whenever the points change, keys the transformed points with the matrix
+  size_t                          points_version_;
+  // opened from a compact copy and not restored since
+  bool                            decoded_;
 
 private:
   osg::ref_ptr<osgManipulator::TranslateAxisDragger>  translate_dragger_;
@@ -97,6 +130,14 @@ private:
 
   QMutex                          mutex_;
 
+  PCLPointCloud::Ptr              transformed_points_;
+  osg::Matrix                     transformed_matrix_;
+  size_t                          transformed_version_;
+
+  SearchBackend<PCLRichPoint>::Ptr  search_;
+  NeighborGraph::ConstPtr           k_nearest_graph_;
+  NeighborGraph::ConstPtr           radius_graph_;
+  size_t                            neighborhood_version_;
 
   bool                            show_draggers_;
   bool                            registered_;
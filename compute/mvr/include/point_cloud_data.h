@@ -0,0 +1,48 @@
+#pragma once
+#ifndef POINT_CLOUD_DATA_H_
+#define POINT_CLOUD_DATA_H_
+
+#include <string>
+
+#include "types.h"
+#include "image_grid.h"
+
+class QFutureInterfaceBase;
+
+// The points of a cloud and its image grid, without the scene graph node, draggers and
+// signals of PointCloud, for the clouds that are only filled and saved or loaded and read.
+// PointCloud loads and saves its files through the same functions, while the creation of a
+// PointCloud also sets up its transform node and the default geometry of its two draggers.
+class PointCloudData : public PCLRichPointCloud
+{
+public:
+  PointCloudData(void);
+  ~PointCloudData(void);
+
+  bool open(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  inline const std::string& getFilename(void) const {return filename_;}
+  // pixel to point mapping of the view, NULL if there is none or it does not fit the points
+  inline const ImageGrid* getImageGrid(void) const
+  {
+    return (!empty() && image_grid_.getPointNumber() == size())?(&image_grid_):(NULL);
+  }
+  inline void setImageGrid(const ImageGrid& image_grid) {image_grid_ = image_grid;}
+
+  // points.pcd comes with points.grid
+  static std::string getGridFilename(const std::string& filename);
+  // image_grid is emptied if the grid file is missing or does not fit the points, with a future the
+  // read of the file reports its progress up to load_progress and stops once the future is canceled
+  static bool load(const std::string& filename, PCLRichPointCloud& point_cloud, ImageGrid& image_grid,
+    QFutureInterfaceBase* future=NULL);
+  static const int load_progress = 90;
+  // .ply files get the points only, .pcd files the grid too, or the stale grid file is removed if it is NULL
+  static bool save(const std::string& filename, const PCLRichPointCloud& point_cloud, const ImageGrid* image_grid);
+
+private:
+  std::string   filename_;
+  ImageGrid     image_grid_;
+};
+
+#endif /*POINT_CLOUD_DATA_H_*/
@@ -43,6 +43,8 @@ public:
   void registrationICP(int max_iterations, double max_distance, int frame);
   void registrationICP(int max_iterations, double max_distance, int frame, int repeat_times);
   void registration(int frame, int segment_threshold);
+  // build and query times of the kd-tree and the grid search on the views of the frame
+  void benchmarkSearch(int frame);
 
 
   public slots:
@@ -52,6 +54,7 @@ public:
     void registrationICP(void);
     void registrationLUM(void);
     void registration(void);
+    void benchmarkSearch(void);
 
 protected:
   virtual void clear();
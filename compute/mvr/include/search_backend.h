@@ -0,0 +1,134 @@
+#pragma once
+#ifndef SEARCH_BACKEND_H_
+#define SEARCH_BACKEND_H_
+
+#include <vector>
+#include <unordered_map>
+
+#include <stdint.h>
+
+#include <Eigen/Geometry>
+#include <boost/shared_ptr.hpp>
+#include <pcl/correspondence.h>
+#include <pcl/kdtree/kdtree_flann.h>
+
+#include "types.h"
+
+class OverlapFilter;
+
+// Nearest neighbor queries over a cloud, answered by the kd-tree of FLANN or by a hashed grid.
+// The grid is much cheaper to build and as fast to query on the nearly uniform density of the scans.
+// The queries are const and may run from several threads, non finite points are never returned.
+template <class PointT>
+class SearchBackend
+{
+public:
+  typedef typename pcl::PointCloud<PointT>::ConstPtr CloudConstPtr;
+  typedef boost::shared_ptr<SearchBackend<PointT> > Ptr;
+
+  enum Type
+  {
+    KDTREE,
+    GRID
+  };
+
+  static Ptr create(Type type);
+
+  virtual ~SearchBackend(void) {}
+
+  virtual Type getType(void) const = 0;
+  virtual const char* getName(void) const = 0;
+
+  // the cloud is shared, not copied, and must not change while it is searched
+  void setInputCloud(const CloudConstPtr& cloud);
+  inline const CloudConstPtr& getInputCloud(void) const {return cloud_;}
+
+  // closest first, fewer than k if the cloud has fewer points
+  virtual int nearestKSearch(const PointT& point, int k,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const = 0;
+  // closest first
+  virtual int radiusSearch(const PointT& point, double radius,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const = 0;
+
+protected:
+  virtual void build(void) = 0;
+
+  CloudConstPtr cloud_;
+};
+
+template <class PointT>
+class KdTreeSearch : public SearchBackend<PointT>
+{
+public:
+  virtual typename SearchBackend<PointT>::Type getType(void) const {return SearchBackend<PointT>::KDTREE;}
+  virtual const char* getName(void) const {return "kd-tree";}
+
+  virtual int nearestKSearch(const PointT& point, int k,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const;
+  virtual int radiusSearch(const PointT& point, double radius,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const;
+
+protected:
+  virtual void build(void);
+
+private:
+  pcl::KdTreeFLANN<PointT>  kdtree_;
+};
+
+// The points sorted by the cubic cell they fall in, with a hash from the occupied cells to their points.
+// k nearest neighbors are searched in rings of cells around the query until no closer point can remain.
+template <class PointT>
+class GridSearch : public SearchBackend<PointT>
+{
+public:
+  // 0 picks the cell size from the density of the cloud, for a few points per occupied cell
+  GridSearch(double cell_size=0.0);
+
+  virtual typename SearchBackend<PointT>::Type getType(void) const {return SearchBackend<PointT>::GRID;}
+  virtual const char* getName(void) const {return "grid";}
+  inline double getCellSize(void) const {return cell_size_;}
+
+  virtual int nearestKSearch(const PointT& point, int k,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const;
+  virtual int radiusSearch(const PointT& point, double radius,
+    std::vector<int>& indices, std::vector<float>& squared_distances) const;
+
+protected:
+  virtual void build(void);
+
+private:
+  struct Cell
+  {
+    uint32_t  begin;
+    uint32_t  end;
+  };
+  typedef std::unordered_map<uint64_t, Cell> CellMap;
+
+  void build(double cell_size);
+  void getCell(const PointT& point, int64_t* cell) const;
+  const Cell* findCell(int64_t x, int64_t y, int64_t z) const;
+
+  double              requested_cell_size_;
+  double              cell_size_;
+  float               min_[3];
+  int64_t             dimensions_[3];
+  // the point indices and positions ordered by cell
+  std::vector<int>    indices_;
+  std::vector<float>  positions_;
+  CellMap             cells_;
+};
+
+// the reciprocal nearest neighbors of the clouds of source_search and target_search within max_distance,
+// like pcl::registration::CorrespondenceEstimation::determineReciprocalCorrespondences, the distances
+// of the correspondences are squared as there. The source points out of target_overlap, the OverlapFilter
+// of the target cloud for at least max_distance, are not queried, it is meant to be built once with the index
+void determineReciprocalCorrespondences(const SearchBackend<PCLPoint>& source_search,
+  const SearchBackend<PCLPoint>& target_search, double max_distance, pcl::Correspondences& correspondences,
+  const OverlapFilter* target_overlap=NULL);
+// the same for clouds in different frames, source_to_target is rigid and maps the source cloud into
+// the frame of the target one, so the indexes of clouds that only change their poses can be kept
+void determineReciprocalCorrespondences(const SearchBackend<PCLPoint>& source_search,
+  const SearchBackend<PCLPoint>& target_search, const Eigen::Affine3f& source_to_target,
+  double max_distance, pcl::Correspondences& correspondences, const OverlapFilter* target_overlap=NULL);
+
+#endif /*SEARCH_BACKEND_H_*/
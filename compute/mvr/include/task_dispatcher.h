@@ -5,11 +5,16 @@
 #include <vector>
 #include <QMutex>
 #include <QObject>
+#include <QStringList>
 #include <boost/shared_ptr.hpp>
 
 #include "point_cloud.h"
 #include "types.h"
 
+class Decoder;
+struct StripeImage;
+struct DecodedPoints;
+
 class TaskImpl
 {
 public:
@@ -48,19 +53,27 @@ private:
 class TaskPointsGeneration : public TaskImpl
 {
 public:
-  TaskPointsGeneration(int frame, int view, int ctr_threshold, int sat_threshold);
+  TaskPointsGeneration(int frame, int view, int ctr_threshold, int sat_threshold,
+    bool bilinear_color, bool fused_generation, bool keep_decode_maps, int normal_radius);
   virtual ~TaskPointsGeneration();
 
-  static QString getExeFilename(void);
   virtual void run(void) const;
 
 private:
   int ctr_threshold_;
   int sat_threshold_;
+  bool bilinear_color_;
+  bool fused_generation_;
+  bool keep_decode_maps_;
+  int normal_radius_;
+
+  static Decoder& getDecoder(void);
 
-  void convertImages(void) const;
-  void deleteImages(void) const;
+  QStringList getImageFilenames(void) const;
+  std::string getImagesSignature(const QStringList& filenames) const;
+  size_t loadImages(const QStringList& filenames, std::vector<StripeImage>& images) const;
   void colorizePoints(void) const;
+  void colorizePoints(const DecodedPoints& points) const;
 };
 
 class TaskRegistration : public TaskImpl
@@ -80,13 +93,15 @@ private:
 class TaskDenoise : public TaskImpl
 {
 public:
-	TaskDenoise(int frame, int segment_threshold);
+	TaskDenoise(int frame, int segment_threshold, double triangle_length, bool component_denoise);
 	virtual ~TaskDenoise();
 
 	virtual void run(void) const;
 
 private:
 	int segment_threshold_;
+	double triangle_length_;
+	bool component_denoise_;
 };
 
 class TaskExtractImages : public TaskImpl
@@ -105,13 +120,16 @@ private:
 class TaskDownsampling : public TaskImpl
 {
 public:
-	TaskDownsampling(int frame, int sample_ratio, std::string folder);
+	TaskDownsampling(int frame, int sample_ratio, int point_budget, bool poisson_disk, std::string folder);
 	virtual ~TaskDownsampling();
 
 	virtual void run(void) const;
 
 private:
 	int sample_ratio_;
+	// points to keep, 0 for the number of points divided by sample_ratio_
+	int point_budget_;
+	bool poisson_disk_;
 	std::string folder_;
 };
 
@@ -133,6 +151,20 @@ public:
 	virtual void run(void) const;
 };
 
+// data cut and outlier removal in one pass, with one save
+class TaskCrop : public TaskImpl
+{
+public:
+	TaskCrop(int frame, bool by_plane, bool by_sphere);
+	virtual ~TaskCrop();
+
+	virtual void run(void) const;
+
+private:
+	bool by_plane_;
+	bool by_sphere_;
+};
+
 class TaskExtractPoints : public TaskImpl
 {
 public:
@@ -161,10 +193,10 @@ public slots:
   void dispatchTaskPointsGeneration(void);
   void dispatchTaskRegistration(void);
   void dispatchTaskDenoise(void);
-  void dispatchTaskDenoiseBySerialOrder(void);
   void dispatchTaskExtractImages(void);
   void dispatchTaskDataCut(void);
   void dispatchTaskRemoveOutliers(void);
+  void dispatchTaskCrop(void);
   void dispatchTaskDownsampling(void);
   void dispatchTaskExtractPoints(void);
   void updateDisplayQueue(int frame, int view);
@@ -183,6 +215,7 @@ private:
   QList<Task>						  extract_images_tasks_;
   QList<Task>						  data_cut_tasks_;
   QList<Task>						  remove_outliers_tasks_;
+  QList<Task>						  crop_tasks_;
   QList<Task>						  downsampling_tasks_;
   QList<Task>						  extract_points_tasks_;
 
@@ -0,0 +1,322 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define COMPACT_POINT_CLOUD_SSE2
+#endif
+
+#include <QtConcurrentMap>
+
+#include "compact_point_cloud.h"
+
+// points per task
+static const size_t block_size = 16384;
+
+// the 65535 levels of int16_t without -32768, so the range is symmetric around the center
+static const float position_levels = 65534.0f;
+static const float position_max = 32767.0f;
+
+CompactPointCloud::CompactPointCloud(void)
+  :width_(0),
+  height_(0),
+  is_dense_(true)
+{
+  for (int i = 0; i < 3; ++ i)
+  {
+    center_[i] = 0.0f;
+    step_[i] = 1.0f;
+  }
+}
+
+CompactPointCloud::~CompactPointCloud(void)
+{
+}
+
+static inline int16_t quantizePosition(float value, float center, float inverse_step)
+{
+  float level = (value-center)*inverse_step;
+  level = std::min(std::max(level, -position_max), position_max);
+
+  return (int16_t)(std::floor(level+0.5f));
+}
+
+static inline float signNotZero(float value)
+{
+  return (value < 0.0f)?(-1.0f):(1.0f);
+}
+
+static inline uint8_t quantizeNormal(float value)
+{
+  return (uint8_t)(std::floor((value*0.5f+0.5f)*255.0f+0.5f));
+}
+
+void CompactPointCloud::encode(const PCLRichPointCloud& point_cloud, size_t begin, size_t end)
+{
+  const PCLRichPoint* points = &point_cloud.points[0];
+  CompactPoint* compact_points = &points_[0];
+  float inverse_step[3] = {1.0f/step_[0], 1.0f/step_[1], 1.0f/step_[2]};
+
+  for (size_t i = begin; i < end; ++ i)
+  {
+    const PCLRichPoint& point = points[i];
+    CompactPoint& compact_point = compact_points[i];
+    compact_point.flags = 0;
+
+    if (pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z))
+    {
+      compact_point.x = quantizePosition(point.x, center_[0], inverse_step[0]);
+      compact_point.y = quantizePosition(point.y, center_[1], inverse_step[1]);
+      compact_point.z = quantizePosition(point.z, center_[2], inverse_step[2]);
+    }
+    else
+    {
+      compact_point.x = compact_point.y = compact_point.z = 0;
+      compact_point.flags |= NON_FINITE_POSITION;
+    }
+
+    compact_point.r = point.r;
+    compact_point.g = point.g;
+    compact_point.b = point.b;
+
+    // projected on the octahedron |x|+|y|+|z| = 1, with the lower half folded over the upper one
+    float length = std::abs(point.normal_x)+std::abs(point.normal_y)+std::abs(point.normal_z);
+    if (length > 0.0f && length <= std::numeric_limits<float>::max())
+    {
+      float u = point.normal_x/length, v = point.normal_y/length;
+      if (point.normal_z < 0.0f)
+      {
+        float folded_u = (1.0f-std::abs(v))*signNotZero(u);
+        float folded_v = (1.0f-std::abs(u))*signNotZero(v);
+        u = folded_u;
+        v = folded_v;
+      }
+      compact_point.normal_u = quantizeNormal(u);
+      compact_point.normal_v = quantizeNormal(v);
+    }
+    else
+    {
+      compact_point.normal_u = compact_point.normal_v = 0;
+      compact_point.flags |= ZERO_NORMAL;
+    }
+  }
+
+  return;
+}
+
+// four points at a time, the flags select the results instead of branches, and the positions and
+// normals are transposed from the lanes to the 16 byte blocks of the points
+void CompactPointCloud::decode(PCLRichPointCloud& point_cloud, size_t begin, size_t end) const
+{
+  const CompactPoint* compact_points = &points_[0];
+  PCLRichPoint* points = &point_cloud.points[0];
+  const float center_x = center_[0], center_y = center_[1], center_z = center_[2];
+  const float step_x = step_[0], step_y = step_[1], step_z = step_[2];
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  const float normal_step = 2.0f/255.0f;
+
+  size_t i = begin;
+#ifdef COMPACT_POINT_CLOUD_SSE2
+  const __m128 sign_mask = _mm_set1_ps(-0.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128i zero_int = _mm_setzero_si128();
+  const __m128i position_flag = _mm_set1_epi32(NON_FINITE_POSITION);
+  const __m128i normal_flag = _mm_set1_epi32(ZERO_NORMAL);
+  for (; i+4 <= end; i += 4)
+  {
+    const CompactPoint* c = compact_points+i;
+
+    __m128i flags = _mm_setr_epi32(c[0].flags, c[1].flags, c[2].flags, c[3].flags);
+    __m128 finite = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, position_flag), zero_int));
+    __m128 normal = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(flags, normal_flag), zero_int));
+
+    __m128 x = _mm_cvtepi32_ps(_mm_setr_epi32(c[0].x, c[1].x, c[2].x, c[3].x));
+    __m128 y = _mm_cvtepi32_ps(_mm_setr_epi32(c[0].y, c[1].y, c[2].y, c[3].y));
+    __m128 z = _mm_cvtepi32_ps(_mm_setr_epi32(c[0].z, c[1].z, c[2].z, c[3].z));
+    x = _mm_add_ps(_mm_set1_ps(center_x), _mm_mul_ps(x, _mm_set1_ps(step_x)));
+    y = _mm_add_ps(_mm_set1_ps(center_y), _mm_mul_ps(y, _mm_set1_ps(step_y)));
+    z = _mm_add_ps(_mm_set1_ps(center_z), _mm_mul_ps(z, _mm_set1_ps(step_z)));
+    x = _mm_or_ps(_mm_and_ps(finite, x), _mm_andnot_ps(finite, _mm_set1_ps(nan)));
+    y = _mm_or_ps(_mm_and_ps(finite, y), _mm_andnot_ps(finite, _mm_set1_ps(nan)));
+    z = _mm_or_ps(_mm_and_ps(finite, z), _mm_andnot_ps(finite, _mm_set1_ps(nan)));
+    __m128 w = one;
+    _MM_TRANSPOSE4_PS(x, y, z, w);
+    _mm_storeu_ps(points[i].data, x);
+    _mm_storeu_ps(points[i+1].data, y);
+    _mm_storeu_ps(points[i+2].data, z);
+    _mm_storeu_ps(points[i+3].data, w);
+
+    __m128 u = _mm_cvtepi32_ps(_mm_setr_epi32(c[0].normal_u, c[1].normal_u, c[2].normal_u, c[3].normal_u));
+    __m128 v = _mm_cvtepi32_ps(_mm_setr_epi32(c[0].normal_v, c[1].normal_v, c[2].normal_v, c[3].normal_v));
+    u = _mm_sub_ps(_mm_mul_ps(u, _mm_set1_ps(normal_step)), one);
+    v = _mm_sub_ps(_mm_mul_ps(v, _mm_set1_ps(normal_step)), one);
+    __m128 n = _mm_sub_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, u)), _mm_andnot_ps(sign_mask, v));
+    __m128 fold = _mm_max_ps(_mm_sub_ps(zero, n), zero);
+    __m128 u_positive = _mm_cmpge_ps(u, zero);
+    __m128 v_positive = _mm_cmpge_ps(v, zero);
+    u = _mm_add_ps(u, _mm_or_ps(_mm_and_ps(u_positive, _mm_sub_ps(zero, fold)), _mm_andnot_ps(u_positive, fold)));
+    v = _mm_add_ps(v, _mm_or_ps(_mm_and_ps(v_positive, _mm_sub_ps(zero, fold)), _mm_andnot_ps(v_positive, fold)));
+    __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(u, u), _mm_mul_ps(v, v)), _mm_mul_ps(n, n)));
+    __m128 scale = _mm_and_ps(normal, _mm_div_ps(one, length));
+    u = _mm_mul_ps(u, scale);
+    v = _mm_mul_ps(v, scale);
+    n = _mm_mul_ps(n, scale);
+    __m128 padding = zero;
+    _MM_TRANSPOSE4_PS(u, v, n, padding);
+    _mm_storeu_ps(points[i].data_n, u);
+    _mm_storeu_ps(points[i+1].data_n, v);
+    _mm_storeu_ps(points[i+2].data_n, n);
+    _mm_storeu_ps(points[i+3].data_n, padding);
+
+    // the color in the first lane and the curvature in the second
+    for (int j = 0; j < 4; ++ j)
+    {
+      int rgba = c[j].b|(c[j].g << 8)|(c[j].r << 16)|(255 << 24);
+      _mm_storeu_ps(points[i+j].data_c, _mm_castsi128_ps(_mm_cvtsi32_si128(rgba)));
+    }
+  }
+#endif
+  for (; i < end; ++ i)
+  {
+    const CompactPoint& compact_point = compact_points[i];
+    PCLRichPoint& point = points[i];
+
+    bool finite = (compact_point.flags & NON_FINITE_POSITION) == 0;
+    point.x = finite?(center_x+compact_point.x*step_x):(nan);
+    point.y = finite?(center_y+compact_point.y*step_y):(nan);
+    point.z = finite?(center_z+compact_point.z*step_z):(nan);
+    point.data[3] = 1.0f;
+
+    point.r = compact_point.r;
+    point.g = compact_point.g;
+    point.b = compact_point.b;
+    point.a = 255;
+
+    float u = compact_point.normal_u*normal_step-1.0f;
+    float v = compact_point.normal_v*normal_step-1.0f;
+    float w = 1.0f-std::abs(u)-std::abs(v);
+    float fold = std::max(-w, 0.0f);
+    u += (u >= 0.0f)?(-fold):(fold);
+    v += (v >= 0.0f)?(-fold):(fold);
+    float scale = ((compact_point.flags & ZERO_NORMAL) == 0)?(1.0f/std::sqrt(u*u+v*v+w*w)):(0.0f);
+    point.normal_x = u*scale;
+    point.normal_y = v*scale;
+    point.normal_z = w*scale;
+    point.data_n[3] = 0.0f;
+    point.curvature = 0.0f;
+  }
+
+  return;
+}
+
+class EncodeBlock
+{
+public:
+  typedef void result_type;
+
+  EncodeBlock(CompactPointCloud& compact_point_cloud, const PCLRichPointCloud& point_cloud)
+    :compact_point_cloud_(compact_point_cloud), point_cloud_(point_cloud)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
+  {
+    compact_point_cloud_.encode(point_cloud_, block.first, block.second);
+
+    return;
+  }
+
+private:
+  CompactPointCloud&        compact_point_cloud_;
+  const PCLRichPointCloud&  point_cloud_;
+};
+
+class DecodeBlock
+{
+public:
+  typedef void result_type;
+
+  DecodeBlock(const CompactPointCloud& compact_point_cloud, PCLRichPointCloud& point_cloud)
+    :compact_point_cloud_(compact_point_cloud), point_cloud_(point_cloud)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
+  {
+    compact_point_cloud_.decode(point_cloud_, block.first, block.second);
+
+    return;
+  }
+
+private:
+  const CompactPointCloud&  compact_point_cloud_;
+  PCLRichPointCloud&        point_cloud_;
+};
+
+static void getBlocks(size_t point_num, std::vector<std::pair<size_t, size_t> >& blocks)
+{
+  for (size_t i = 0; i < point_num; i += block_size)
+    blocks.push_back(std::make_pair(i, std::min(i+block_size, point_num)));
+
+  return;
+}
+
+void CompactPointCloud::encode(const PCLRichPointCloud& point_cloud)
+{
+  size_t point_num = point_cloud.size();
+  width_ = point_cloud.width;
+  height_ = point_cloud.height;
+  is_dense_ = point_cloud.is_dense;
+
+  float min[3] = {std::numeric_limits<float>::max(), std::numeric_limits<float>::max(), std::numeric_limits<float>::max()};
+  float max[3] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+  for (size_t i = 0; i < point_num; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud.points[i];
+    if (!pcl_isfinite(point.x) || !pcl_isfinite(point.y) || !pcl_isfinite(point.z))
+      continue;
+    const float position[3] = {point.x, point.y, point.z};
+    for (int j = 0; j < 3; ++ j)
+    {
+      min[j] = std::min(min[j], position[j]);
+      max[j] = std::max(max[j], position[j]);
+    }
+  }
+
+  for (int i = 0; i < 3; ++ i)
+  {
+    if (!(min[i] <= max[i]))
+      min[i] = max[i] = 0.0f;
+    center_[i] = (min[i]+max[i])/2;
+    step_[i] = (max[i]-min[i])/position_levels;
+    if (!(step_[i] > 0.0f))
+      step_[i] = 1.0f;
+  }
+
+  std::vector<CompactPoint>(point_num).swap(points_);
+  if (point_num == 0)
+    return;
+
+  std::vector<std::pair<size_t, size_t> > blocks;
+  getBlocks(point_num, blocks);
+  QtConcurrent::blockingMap(blocks, EncodeBlock(*this, point_cloud));
+
+  return;
+}
+
+void CompactPointCloud::decode(PCLRichPointCloud& point_cloud) const
+{
+  size_t point_num = points_.size();
+  point_cloud.points.resize(point_num);
+  point_cloud.width = width_;
+  point_cloud.height = height_;
+  point_cloud.is_dense = is_dense_;
+  if (point_num == 0)
+    return;
+
+  std::vector<std::pair<size_t, size_t> > blocks;
+  getBlocks(point_num, blocks);
+  QtConcurrent::blockingMap(blocks, DecodeBlock(*this, point_cloud));
+
+  return;
+}
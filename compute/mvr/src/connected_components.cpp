@@ -0,0 +1,330 @@
+#include <cmath>
+#include <atomic>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+#include <stdint.h>
+
+#include <QtConcurrentMap>
+
+#include "connected_components.h"
+
+// bits of a cell coordinate in its key
+static const int key_bits = 21;
+static const int64_t key_mask = (int64_t(1) << key_bits)-1;
+static const double key_max = double(key_mask);
+
+// cells per task
+static const size_t block_size = 1024;
+
+typedef std::vector<std::atomic<int> > Parents;
+
+// parents only ever point to smaller indices, the root of a set is its smallest element
+static int findRoot(Parents& parents, int i)
+{
+  for (;;)
+  {
+    int parent = parents[i].load();
+    if (parent == i)
+      return i;
+
+    // path halving, skipped if another thread moved the parent meanwhile
+    int grand_parent = parents[parent].load();
+    if (grand_parent != parent)
+      parents[i].compare_exchange_weak(parent, grand_parent);
+    i = grand_parent;
+  }
+}
+
+static void unite(Parents& parents, int a, int b)
+{
+  for (;;)
+  {
+    a = findRoot(parents, a);
+    b = findRoot(parents, b);
+    if (a == b)
+      return;
+    if (a > b)
+      std::swap(a, b);
+
+    // fails if b got a parent since it was found, then the roots are searched again
+    int expected = b;
+    if (parents[b].compare_exchange_strong(expected, a))
+      return;
+  }
+}
+
+static inline uint64_t getKey(int64_t x, int64_t y, int64_t z)
+{
+  return (uint64_t(x) << (2*key_bits)) | (uint64_t(y) << key_bits) | uint64_t(z);
+}
+
+struct ComponentCell
+{
+  uint64_t  key;
+  int       begin;
+  int       end;
+};
+
+// the finite points sorted by cell, the union-find runs on their sorted positions
+struct ComponentGrid
+{
+  double                                cell_size;
+  // whether the cells are small enough for their points to be linked without comparing them
+  bool                                  cells_linked;
+  int64_t                               dimensions[3];
+  std::vector<int>                      indices;
+  std::vector<float>                    positions;
+  std::vector<ComponentCell>            cells;
+  std::unordered_map<uint64_t, size_t>  cell_map;
+  // the offsets to the following cells that may hold points within the distance
+  std::vector<int64_t>                  offsets;
+};
+
+class LinkCells
+{
+public:
+  typedef void result_type;
+
+  LinkCells(const ComponentGrid& grid, float squared_distance, Parents& parents)
+    :grid_(grid), squared_distance_(squared_distance), parents_(parents)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
+  {
+    for (size_t c = block.first; c < block.second; ++ c)
+    {
+      const ComponentCell& cell = grid_.cells[c];
+      if (grid_.cells_linked)
+      {
+        for (int i = cell.begin+1; i < cell.end; ++ i)
+          unite(parents_, cell.begin, i);
+      }
+      else
+        linkPoints(cell, cell);
+
+      int64_t x = int64_t(cell.key >> (2*key_bits));
+      int64_t y = int64_t(cell.key >> key_bits) & key_mask;
+      int64_t z = int64_t(cell.key) & key_mask;
+      for (size_t i = 0, i_end = grid_.offsets.size(); i < i_end; i += 3)
+      {
+        int64_t neighbor_x = x+grid_.offsets[i];
+        int64_t neighbor_y = y+grid_.offsets[i+1];
+        int64_t neighbor_z = z+grid_.offsets[i+2];
+        if (neighbor_x < 0 || neighbor_x >= grid_.dimensions[0]
+          || neighbor_y < 0 || neighbor_y >= grid_.dimensions[1]
+          || neighbor_z < 0 || neighbor_z >= grid_.dimensions[2])
+          continue;
+
+        std::unordered_map<uint64_t, size_t>::const_iterator it = grid_.cell_map.find(getKey(neighbor_x, neighbor_y, neighbor_z));
+        if (it == grid_.cell_map.end())
+          continue;
+
+        const ComponentCell& neighbor = grid_.cells[it->second];
+        // one close pair links two linked cells
+        if (grid_.cells_linked && findRoot(parents_, cell.begin) == findRoot(parents_, neighbor.begin))
+          continue;
+        linkPoints(cell, neighbor);
+      }
+    }
+
+    return;
+  }
+
+private:
+  void linkPoints(const ComponentCell& cell, const ComponentCell& neighbor) const
+  {
+    const float* positions = &grid_.positions[0];
+    for (int i = cell.begin; i < cell.end; ++ i)
+    {
+      const float* position = positions+3*i;
+      for (int j = (&cell == &neighbor)?(i+1):(neighbor.begin); j < neighbor.end; ++ j)
+      {
+        const float* neighbor_position = positions+3*j;
+        float dx = position[0]-neighbor_position[0];
+        float dy = position[1]-neighbor_position[1];
+        float dz = position[2]-neighbor_position[2];
+        if (dx*dx+dy*dy+dz*dz > squared_distance_)
+          continue;
+
+        unite(parents_, i, j);
+        if (grid_.cells_linked)
+          return;
+      }
+    }
+
+    return;
+  }
+
+  const ComponentGrid&  grid_;
+  float                 squared_distance_;
+  Parents&              parents_;
+};
+
+ConnectedComponents::ConnectedComponents(const PCLRichPointCloud& point_cloud, double distance)
+  :point_cloud_(point_cloud),
+  distance_(distance)
+{
+}
+
+ConnectedComponents::~ConnectedComponents(void)
+{
+}
+
+static inline bool isFinite(const PCLRichPoint& point)
+{
+  return pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z);
+}
+
+static void buildGrid(const PCLRichPointCloud& point_cloud, double distance, ComponentGrid& grid)
+{
+  float min[3], max[3];
+  for (int i = 0; i < 3; ++ i)
+  {
+    min[i] = std::numeric_limits<float>::max();
+    max[i] = -std::numeric_limits<float>::max();
+  }
+  for (size_t i = 0, i_end = point_cloud.size(); i < i_end; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    const float position[3] = {point.x, point.y, point.z};
+    for (int j = 0; j < 3; ++ j)
+    {
+      min[j] = std::min(min[j], position[j]);
+      max[j] = std::max(max[j], position[j]);
+    }
+  }
+
+  double extent = 0.0;
+  for (int i = 0; i < 3; ++ i)
+    if (min[i] <= max[i])
+      extent = std::max(extent, double(max[i]-min[i]));
+
+  // the cells only grow past the diagonal of the distance for clouds too wide for the keys
+  double linked_cell_size = distance/std::sqrt(3.0);
+  grid.cell_size = std::max(linked_cell_size, extent/(key_max-1));
+  grid.cells_linked = (grid.cell_size == linked_cell_size);
+  for (int i = 0; i < 3; ++ i)
+    grid.dimensions[i] = (int64_t)(extent/grid.cell_size)+1;
+
+  std::vector<std::pair<uint64_t, int> > keyed_indices;
+  keyed_indices.reserve(point_cloud.size());
+  for (size_t i = 0, i_end = point_cloud.size(); i < i_end; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    int64_t x = (int64_t)((point.x-min[0])/grid.cell_size);
+    int64_t y = (int64_t)((point.y-min[1])/grid.cell_size);
+    int64_t z = (int64_t)((point.z-min[2])/grid.cell_size);
+    keyed_indices.push_back(std::make_pair(getKey(x, y, z), int(i)));
+  }
+  std::sort(keyed_indices.begin(), keyed_indices.end());
+
+  size_t point_num = keyed_indices.size();
+  grid.indices.resize(point_num);
+  grid.positions.resize(3*point_num);
+  for (size_t i = 0; i < point_num; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud.points[keyed_indices[i].second];
+    grid.indices[i] = keyed_indices[i].second;
+    grid.positions[3*i] = point.x;
+    grid.positions[3*i+1] = point.y;
+    grid.positions[3*i+2] = point.z;
+
+    if (i == 0 || keyed_indices[i].first != keyed_indices[i-1].first)
+    {
+      ComponentCell cell = {keyed_indices[i].first, int(i), int(i)};
+      grid.cells.push_back(cell);
+    }
+    grid.cells.back().end = int(i+1);
+  }
+
+  grid.cell_map.reserve(grid.cells.size());
+  for (size_t i = 0, i_end = grid.cells.size(); i < i_end; ++ i)
+    grid.cell_map[grid.cells[i].key] = i;
+
+  // the cells after the current one in key order whose closest corners are within the distance,
+  // so every pair of cells is compared once
+  int64_t reach = (int64_t)(std::ceil(distance/grid.cell_size));
+  double squared_gap_max = distance*distance/(grid.cell_size*grid.cell_size);
+  for (int64_t dx = 0; dx <= reach; ++ dx)
+  {
+    for (int64_t dy = -reach; dy <= reach; ++ dy)
+    {
+      for (int64_t dz = -reach; dz <= reach; ++ dz)
+      {
+        if (dx == 0 && (dy < 0 || (dy == 0 && dz <= 0)))
+          continue;
+
+        double gap_x = double(std::max(std::abs(dx)-1, int64_t(0)));
+        double gap_y = double(std::max(std::abs(dy)-1, int64_t(0)));
+        double gap_z = double(std::max(std::abs(dz)-1, int64_t(0)));
+        if (gap_x*gap_x+gap_y*gap_y+gap_z*gap_z > squared_gap_max)
+          continue;
+
+        grid.offsets.push_back(dx);
+        grid.offsets.push_back(dy);
+        grid.offsets.push_back(dz);
+      }
+    }
+  }
+
+  return;
+}
+
+size_t ConnectedComponents::compute(std::vector<int>& components, std::vector<size_t>& component_sizes) const
+{
+  size_t point_num = point_cloud_.size();
+  components.assign(point_num, -1);
+  component_sizes.clear();
+
+  ComponentGrid grid;
+  Parents parents(0);
+  if (distance_ > 0)
+  {
+    buildGrid(point_cloud_, distance_, grid);
+
+    Parents(grid.indices.size()).swap(parents);
+    for (size_t i = 0, i_end = grid.indices.size(); i < i_end; ++ i)
+      parents[i].store(int(i));
+
+    std::vector<std::pair<size_t, size_t> > blocks;
+    for (size_t i = 0, i_end = grid.cells.size(); i < i_end; i += block_size)
+      blocks.push_back(std::make_pair(i, std::min(i+block_size, i_end)));
+    QtConcurrent::blockingMap(blocks, LinkCells(grid, (float)(distance_*distance_), parents));
+  }
+
+  // the roots of the sorted positions, numbered in point order
+  std::vector<int> sorted_positions(point_num, -1);
+  for (size_t i = 0, i_end = grid.indices.size(); i < i_end; ++ i)
+    sorted_positions[grid.indices[i]] = int(i);
+  std::vector<int> root_components(grid.indices.size(), -1);
+  for (size_t i = 0; i < point_num; ++ i)
+  {
+    int component = -1;
+    if (sorted_positions[i] >= 0)
+    {
+      int& root_component = root_components[findRoot(parents, sorted_positions[i])];
+      if (root_component < 0)
+      {
+        root_component = int(component_sizes.size());
+        component_sizes.push_back(0);
+      }
+      component = root_component;
+    }
+    else
+    {
+      component = int(component_sizes.size());
+      component_sizes.push_back(0);
+    }
+
+    components[i] = component;
+    component_sizes[component] ++;
+  }
+
+  return component_sizes.size();
+}
@@ -0,0 +1,247 @@
+#include <cstring>
+#include <stdint.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CROP_ENGINE_SSE2
+#endif
+
+#include <QtConcurrentMap>
+
+#include "crop_engine.h"
+
+// points per task
+static const size_t block_size = 16384;
+
+CropEngine::CropEngine(void)
+{
+}
+
+CropEngine::~CropEngine(void)
+{
+}
+
+void CropEngine::addHalfSpace(const osg::Vec4& plane)
+{
+  half_spaces_.push_back(osg::Vec4d(plane.x(), plane.y(), plane.z(), plane.w()));
+
+  return;
+}
+
+void CropEngine::addSphere(const osg::Vec3& center, double radius)
+{
+  Sphere sphere;
+  sphere.center = center;
+  sphere.squared_radius = radius*radius;
+  spheres_.push_back(sphere);
+
+  return;
+}
+
+void CropEngine::addBox(const osg::Vec3& min, const osg::Vec3& max)
+{
+  Box box;
+  box.min = min;
+  box.max = max;
+  boxes_.push_back(box);
+
+  return;
+}
+
+void CropEngine::clear(void)
+{
+  half_spaces_.clear();
+  spheres_.clear();
+  boxes_.clear();
+
+  return;
+}
+
+// points per tile, their coordinates are gathered from the 48 byte points once and every region
+// is tested on them while they are in the cache
+static const size_t tile_size = 256;
+
+// the tests keep the precision of the former per point loops, the coordinate differences
+// in float and the rest in double, so the same points are cropped
+
+#ifdef CROP_ENGINE_SSE2
+// the four bits of a movemask spread over the flags of four points
+static inline void orFlags(unsigned char* flags, int cropped)
+{
+  static const uint32_t spread[16] = {
+    0x00000000, 0x00000001, 0x00000100, 0x00000101, 0x00010000, 0x00010001, 0x00010100, 0x00010101,
+    0x01000000, 0x01000001, 0x01000100, 0x01000101, 0x01010000, 0x01010001, 0x01010100, 0x01010101};
+
+  uint32_t four_flags;
+  std::memcpy(&four_flags, flags, 4);
+  four_flags |= spread[cropped];
+  std::memcpy(flags, &four_flags, 4);
+
+  return;
+}
+#endif
+
+static void cropHalfSpace(const float* x, const float* y, const float* z, size_t point_num,
+  const osg::Vec4d& plane, unsigned char* flags)
+{
+  double a = plane.x(), b = plane.y(), c = plane.z(), d = plane.w();
+  size_t i = 0;
+#ifdef CROP_ENGINE_SSE2
+  __m128d a2 = _mm_set1_pd(a), b2 = _mm_set1_pd(b), c2 = _mm_set1_pd(c), d2 = _mm_set1_pd(d);
+  __m128d zero = _mm_setzero_pd();
+  for (; i+4 <= point_num; i += 4)
+  {
+    __m128 x4 = _mm_loadu_ps(x+i), y4 = _mm_loadu_ps(y+i), z4 = _mm_loadu_ps(z+i);
+    int cropped = 0;
+    for (int half = 0; half < 2; ++ half)
+    {
+      __m128d x2 = _mm_cvtps_pd(x4), y2 = _mm_cvtps_pd(y4), z2 = _mm_cvtps_pd(z4);
+      __m128d check = _mm_add_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(a2, x2), _mm_mul_pd(b2, y2)), _mm_mul_pd(c2, z2)), d2);
+      cropped |= _mm_movemask_pd(_mm_cmple_pd(check, zero)) << (2*half);
+      x4 = _mm_movehl_ps(x4, x4);
+      y4 = _mm_movehl_ps(y4, y4);
+      z4 = _mm_movehl_ps(z4, z4);
+    }
+    orFlags(flags+i, cropped);
+  }
+#endif
+  for (; i < point_num; ++ i)
+  {
+    double check = a*x[i] + b*y[i] + c*z[i] + d;
+    flags[i] |= (unsigned char)(check <= 0);
+  }
+
+  return;
+}
+
+static void cropSphere(const float* x, const float* y, const float* z, size_t point_num,
+  const osg::Vec3& center, double squared_radius, unsigned char* flags)
+{
+  float center_x = center.x(), center_y = center.y(), center_z = center.z();
+  size_t i = 0;
+#ifdef CROP_ENGINE_SSE2
+  __m128 center_x4 = _mm_set1_ps(center_x), center_y4 = _mm_set1_ps(center_y), center_z4 = _mm_set1_ps(center_z);
+  __m128d squared_radius2 = _mm_set1_pd(squared_radius);
+  __m128d zero = _mm_setzero_pd();
+  for (; i+4 <= point_num; i += 4)
+  {
+    __m128 dx4 = _mm_sub_ps(_mm_loadu_ps(x+i), center_x4);
+    __m128 dy4 = _mm_sub_ps(_mm_loadu_ps(y+i), center_y4);
+    __m128 dz4 = _mm_sub_ps(_mm_loadu_ps(z+i), center_z4);
+    int cropped = 0;
+    for (int half = 0; half < 2; ++ half)
+    {
+      __m128d dx = _mm_cvtps_pd(dx4), dy = _mm_cvtps_pd(dy4), dz = _mm_cvtps_pd(dz4);
+      __m128d check = _mm_sub_pd(_mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)), _mm_mul_pd(dz, dz)), squared_radius2);
+      cropped |= _mm_movemask_pd(_mm_cmple_pd(check, zero)) << (2*half);
+      dx4 = _mm_movehl_ps(dx4, dx4);
+      dy4 = _mm_movehl_ps(dy4, dy4);
+      dz4 = _mm_movehl_ps(dz4, dz4);
+    }
+    orFlags(flags+i, cropped);
+  }
+#endif
+  for (; i < point_num; ++ i)
+  {
+    double dx = x[i]-center_x, dy = y[i]-center_y, dz = z[i]-center_z;
+    double check = dx*dx + dy*dy + dz*dz - squared_radius;
+    flags[i] |= (unsigned char)(check <= 0);
+  }
+
+  return;
+}
+
+static void cropBox(const float* x, const float* y, const float* z, size_t point_num,
+  const osg::Vec3& min, const osg::Vec3& max, unsigned char* flags)
+{
+  size_t i = 0;
+#ifdef CROP_ENGINE_SSE2
+  __m128 min_x = _mm_set1_ps(min.x()), min_y = _mm_set1_ps(min.y()), min_z = _mm_set1_ps(min.z());
+  __m128 max_x = _mm_set1_ps(max.x()), max_y = _mm_set1_ps(max.y()), max_z = _mm_set1_ps(max.z());
+  for (; i+4 <= point_num; i += 4)
+  {
+    __m128 x4 = _mm_loadu_ps(x+i), y4 = _mm_loadu_ps(y+i), z4 = _mm_loadu_ps(z+i);
+    __m128 inside = _mm_and_ps(_mm_cmpge_ps(x4, min_x), _mm_cmple_ps(x4, max_x));
+    inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(y4, min_y), _mm_cmple_ps(y4, max_y)));
+    inside = _mm_and_ps(inside, _mm_and_ps(_mm_cmpge_ps(z4, min_z), _mm_cmple_ps(z4, max_z)));
+    int cropped = _mm_movemask_ps(inside);
+    orFlags(flags+i, cropped);
+  }
+#endif
+  for (; i < point_num; ++ i)
+    flags[i] |= (unsigned char)((x[i] >= min.x()) & (x[i] <= max.x())
+      & (y[i] >= min.y()) & (y[i] <= max.y()) & (z[i] >= min.z()) & (z[i] <= max.z()));
+
+  return;
+}
+
+void CropEngine::evaluate(const PCLRichPointCloud& point_cloud, size_t begin, size_t end, unsigned char* flags) const
+{
+  const PCLRichPoint* points = &point_cloud.points[0];
+  float x[tile_size], y[tile_size], z[tile_size];
+
+  for (size_t tile = begin; tile < end; tile += tile_size)
+  {
+    size_t point_num = std::min(tile_size, end-tile);
+    unsigned char* tile_flags = flags+tile;
+    for (size_t i = 0; i < point_num; ++ i)
+    {
+      const PCLRichPoint& point = points[tile+i];
+      x[i] = point.x;
+      y[i] = point.y;
+      z[i] = point.z;
+      tile_flags[i] = 0;
+    }
+
+    for (size_t j = 0, j_end = half_spaces_.size(); j < j_end; ++ j)
+      cropHalfSpace(x, y, z, point_num, half_spaces_[j], tile_flags);
+    for (size_t j = 0, j_end = spheres_.size(); j < j_end; ++ j)
+      cropSphere(x, y, z, point_num, spheres_[j].center, spheres_[j].squared_radius, tile_flags);
+    for (size_t j = 0, j_end = boxes_.size(); j < j_end; ++ j)
+      cropBox(x, y, z, point_num, boxes_[j].min, boxes_[j].max, tile_flags);
+  }
+
+  return;
+}
+
+class CropBlock
+{
+public:
+  typedef void result_type;
+
+  CropBlock(const CropEngine& crop_engine, const PCLRichPointCloud& point_cloud, unsigned char* flags)
+    :crop_engine_(crop_engine), point_cloud_(point_cloud), flags_(flags)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
+  {
+    crop_engine_.evaluate(point_cloud_, block.first, block.second, flags_);
+
+    return;
+  }
+
+private:
+  const CropEngine&         crop_engine_;
+  const PCLRichPointCloud&  point_cloud_;
+  unsigned char*            flags_;
+};
+
+size_t CropEngine::evaluate(const PCLRichPointCloud& point_cloud, std::vector<unsigned char>& flags) const
+{
+  size_t point_num = point_cloud.size();
+  flags.assign(point_num, 0);
+  if (point_num == 0 || empty())
+    return 0;
+
+  std::vector<std::pair<size_t, size_t> > blocks;
+  for (size_t i = 0; i < point_num; i += block_size)
+    blocks.push_back(std::make_pair(i, std::min(i+block_size, point_num)));
+  QtConcurrent::blockingMap(blocks, CropBlock(*this, point_cloud, &flags[0]));
+
+  size_t cropped_num = 0;
+  for (size_t i = 0; i < point_num; ++ i)
+    cropped_num += flags[i];
+
+  return cropped_num;
+}
@@ -0,0 +1,393 @@
+#include <cmath>
+#include <limits>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#include <stdint.h>
+
+#include <QtConcurrentMap>
+
+#include "downsampler.h"
+
+// points per task of the voxel grid
+static const size_t block_size = 65536;
+
+// bits of a voxel or cell coordinate in its key
+static const int key_bits = 21;
+static const double key_max = double((1 << key_bits)-1);
+
+// searching the scale for a point budget stops within this fraction under the budget
+static const double budget_tolerance = 0.05;
+static const int max_search_iterations = 12;
+
+static inline bool isFinite(const PCLRichPoint& point)
+{
+  return pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z);
+}
+
+static inline uint64_t getKey(uint64_t x, uint64_t y, uint64_t z)
+{
+  return (x << (2*key_bits)) | (y << key_bits) | z;
+}
+
+Downsampler::Downsampler(const PCLRichPointCloud& point_cloud)
+  :point_cloud_(point_cloud)
+{
+  for (int i = 0; i < 3; ++ i)
+  {
+    min_[i] = std::numeric_limits<float>::max();
+    max_[i] = -std::numeric_limits<float>::max();
+  }
+
+  for (size_t i = 0, i_end = point_cloud_.size(); i < i_end; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud_.points[i];
+    if (!isFinite(point))
+      continue;
+    const float position[3] = {point.x, point.y, point.z};
+    for (int j = 0; j < 3; ++ j)
+    {
+      min_[j] = std::min(min_[j], position[j]);
+      max_[j] = std::max(max_[j], position[j]);
+    }
+  }
+
+  for (int i = 0; i < 3; ++ i)
+    if (!(min_[i] <= max_[i]))
+      min_[i] = max_[i] = 0.0f;
+}
+
+Downsampler::~Downsampler(void)
+{
+}
+
+struct Voxel
+{
+  Voxel(void)
+    :x(0), y(0), z(0), normal_x(0), normal_y(0), normal_z(0), curvature(0),
+    r(0), g(0), b(0), count(0), first(std::numeric_limits<size_t>::max())
+  {}
+
+  void add(const Voxel& voxel)
+  {
+    x += voxel.x;
+    y += voxel.y;
+    z += voxel.z;
+    normal_x += voxel.normal_x;
+    normal_y += voxel.normal_y;
+    normal_z += voxel.normal_z;
+    curvature += voxel.curvature;
+    r += voxel.r;
+    g += voxel.g;
+    b += voxel.b;
+    count += voxel.count;
+    first = std::min(first, voxel.first);
+
+    return;
+  }
+
+  double    x, y, z;
+  double    normal_x, normal_y, normal_z;
+  double    curvature;
+  uint64_t  r, g, b;
+  size_t    count;
+  // the voxels are output in the order of their first points
+  size_t    first;
+};
+
+typedef std::unordered_map<uint64_t, Voxel> VoxelMap;
+
+// a block of points and the voxels it occupies, summed in point order so the result does not
+// depend on the threads, the blocks are merged in their order too
+struct VoxelBlock
+{
+  size_t    begin;
+  size_t    end;
+  VoxelMap  voxels;
+};
+
+class AccumulateVoxels
+{
+public:
+  typedef void result_type;
+
+  AccumulateVoxels(const PCLRichPointCloud& point_cloud, const float* min, double voxel_size)
+    :point_cloud_(point_cloud), min_(min), inverse_size_(1.0/voxel_size)
+  {}
+
+  void operator()(VoxelBlock& block) const
+  {
+    for (size_t i = block.begin; i < block.end; ++ i)
+    {
+      const PCLRichPoint& point = point_cloud_.points[i];
+      if (!isFinite(point))
+        continue;
+
+      uint64_t x = (uint64_t)(std::min((point.x-min_[0])*inverse_size_, key_max));
+      uint64_t y = (uint64_t)(std::min((point.y-min_[1])*inverse_size_, key_max));
+      uint64_t z = (uint64_t)(std::min((point.z-min_[2])*inverse_size_, key_max));
+
+      Voxel& voxel = block.voxels[getKey(x, y, z)];
+      voxel.x += point.x;
+      voxel.y += point.y;
+      voxel.z += point.z;
+      voxel.normal_x += point.normal_x;
+      voxel.normal_y += point.normal_y;
+      voxel.normal_z += point.normal_z;
+      voxel.curvature += point.curvature;
+      voxel.r += point.r;
+      voxel.g += point.g;
+      voxel.b += point.b;
+      voxel.count ++;
+      voxel.first = std::min(voxel.first, i);
+    }
+
+    return;
+  }
+
+private:
+  const PCLRichPointCloud&  point_cloud_;
+  const float*              min_;
+  double                    inverse_size_;
+};
+
+static bool compareFirst(const Voxel* a, const Voxel* b)
+{
+  return a->first < b->first;
+}
+
+void Downsampler::voxelGrid(double voxel_size, PCLRichPointCloud& downsampled) const
+{
+  downsampled.clear();
+
+  size_t point_num = point_cloud_.size();
+  if (point_num == 0)
+    return;
+
+  // the keys have key_bits per coordinate
+  double extent = std::max(std::max(max_[0]-min_[0], max_[1]-min_[1]), max_[2]-min_[2]);
+  voxel_size = std::max(voxel_size, extent/key_max);
+  if (!(voxel_size > 0))
+    voxel_size = 1.0;
+
+  std::vector<VoxelBlock> blocks((point_num+block_size-1)/block_size);
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+  {
+    blocks[i].begin = i*block_size;
+    blocks[i].end = std::min(blocks[i].begin+block_size, point_num);
+  }
+  QtConcurrent::blockingMap(blocks, AccumulateVoxels(point_cloud_, min_, voxel_size));
+
+  VoxelMap voxels;
+  voxels.swap(blocks[0].voxels);
+  for (size_t i = 1, i_end = blocks.size(); i < i_end; ++ i)
+  {
+    for (VoxelMap::const_iterator it = blocks[i].voxels.begin(); it != blocks[i].voxels.end(); ++ it)
+      voxels[it->first].add(it->second);
+    VoxelMap().swap(blocks[i].voxels);
+  }
+
+  std::vector<const Voxel*> ordered_voxels;
+  ordered_voxels.reserve(voxels.size());
+  for (VoxelMap::const_iterator it = voxels.begin(); it != voxels.end(); ++ it)
+    ordered_voxels.push_back(&(it->second));
+  std::sort(ordered_voxels.begin(), ordered_voxels.end(), compareFirst);
+
+  downsampled.points.resize(ordered_voxels.size());
+  for (size_t i = 0, i_end = ordered_voxels.size(); i < i_end; ++ i)
+  {
+    const Voxel& voxel = *ordered_voxels[i];
+    PCLRichPoint& point = downsampled.points[i];
+    point = point_cloud_.points[voxel.first];
+
+    double count = double(voxel.count);
+    point.x = (float)(voxel.x/count);
+    point.y = (float)(voxel.y/count);
+    point.z = (float)(voxel.z/count);
+    point.r = (uint8_t)((voxel.r+voxel.count/2)/voxel.count);
+    point.g = (uint8_t)((voxel.g+voxel.count/2)/voxel.count);
+    point.b = (uint8_t)((voxel.b+voxel.count/2)/voxel.count);
+
+    double length = std::sqrt(voxel.normal_x*voxel.normal_x+voxel.normal_y*voxel.normal_y+voxel.normal_z*voxel.normal_z);
+    double scale = (length > 0)?(1.0/length):(0.0);
+    point.normal_x = (float)(voxel.normal_x*scale);
+    point.normal_y = (float)(voxel.normal_y*scale);
+    point.normal_z = (float)(voxel.normal_z*scale);
+    point.curvature = (float)(voxel.curvature/count);
+  }
+  downsampled.width = (uint32_t)(downsampled.points.size());
+  downsampled.height = 1;
+  downsampled.is_dense = true;
+
+  return;
+}
+
+// a fixed pseudo random order of the points, the same on every platform, so the accepted points
+// do not follow the scan lines
+static inline uint64_t mixIndex(uint64_t index)
+{
+  uint64_t z = index+0x9E3779B97F4A7C15ULL;
+  z = (z^(z >> 30))*0xBF58476D1CE4E5B9ULL;
+  z = (z^(z >> 27))*0x94D049BB133111EBULL;
+
+  return z^(z >> 31);
+}
+
+void Downsampler::getPoissonDiskOrder(std::vector<size_t>& order) const
+{
+  std::vector<std::pair<uint64_t, size_t> > mixed_order;
+  mixed_order.reserve(point_cloud_.size());
+  for (size_t i = 0, i_end = point_cloud_.size(); i < i_end; ++ i)
+    if (isFinite(point_cloud_.points[i]))
+      mixed_order.push_back(std::make_pair(mixIndex(i), i));
+  std::sort(mixed_order.begin(), mixed_order.end());
+
+  order.resize(mixed_order.size());
+  for (size_t i = 0, i_end = mixed_order.size(); i < i_end; ++ i)
+    order[i] = mixed_order[i].second;
+
+  return;
+}
+
+void Downsampler::poissonDisk(double radius, PCLRichPointCloud& downsampled) const
+{
+  std::vector<size_t> order;
+  getPoissonDiskOrder(order);
+  poissonDisk(radius, order, downsampled);
+
+  return;
+}
+
+// the points are tried in order and kept if no kept point is closer than the radius
+void Downsampler::poissonDisk(double radius, const std::vector<size_t>& order, PCLRichPointCloud& downsampled) const
+{
+  downsampled.clear();
+
+  if (order.empty())
+    return;
+
+  // cells of the radius, so the points closer than it are in the 27 cells around
+  double extent = std::max(std::max(max_[0]-min_[0], max_[1]-min_[1]), max_[2]-min_[2]);
+  radius = std::max(radius, extent/(key_max-2));
+  if (!(radius > 0))
+    radius = 1.0;
+  double inverse_size = 1.0/radius;
+  double squared_radius = radius*radius;
+
+  // the accepted points of a cell are chained from the last one
+  std::unordered_map<uint64_t, size_t> cells;
+  std::vector<size_t> accepted;
+  std::vector<size_t> next;
+  const size_t none = std::numeric_limits<size_t>::max();
+
+  for (size_t i = 0, i_end = order.size(); i < i_end; ++ i)
+  {
+    const PCLRichPoint& point = point_cloud_.points[order[i]];
+    // shifted by one cell, so the cells around stay non negative
+    uint64_t x = (uint64_t)((point.x-min_[0])*inverse_size)+1;
+    uint64_t y = (uint64_t)((point.y-min_[1])*inverse_size)+1;
+    uint64_t z = (uint64_t)((point.z-min_[2])*inverse_size)+1;
+
+    bool covered = false;
+    for (uint64_t cx = x-1; cx <= x+1 && !covered; ++ cx)
+    {
+      for (uint64_t cy = y-1; cy <= y+1 && !covered; ++ cy)
+      {
+        for (uint64_t cz = z-1; cz <= z+1 && !covered; ++ cz)
+        {
+          std::unordered_map<uint64_t, size_t>::const_iterator it = cells.find(getKey(cx, cy, cz));
+          if (it == cells.end())
+            continue;
+          for (size_t j = it->second; j != none && !covered; j = next[j])
+          {
+            const PCLRichPoint& other = point_cloud_.points[accepted[j]];
+            double dx = point.x-other.x, dy = point.y-other.y, dz = point.z-other.z;
+            covered = (dx*dx+dy*dy+dz*dz < squared_radius);
+          }
+        }
+      }
+    }
+    if (covered)
+      continue;
+
+    std::unordered_map<uint64_t, size_t>::iterator cell = cells.insert(std::make_pair(getKey(x, y, z), none)).first;
+    next.push_back(cell->second);
+    cell->second = accepted.size();
+    accepted.push_back(order[i]);
+  }
+
+  std::sort(accepted.begin(), accepted.end());
+  downsampled.points.resize(accepted.size());
+  for (size_t i = 0, i_end = accepted.size(); i < i_end; ++ i)
+    downsampled.points[i] = point_cloud_.points[accepted[i]];
+  downsampled.width = (uint32_t)(downsampled.points.size());
+  downsampled.height = 1;
+  downsampled.is_dense = true;
+
+  return;
+}
+
+double Downsampler::voxelGridToBudget(size_t point_budget, PCLRichPointCloud& downsampled) const
+{
+  return searchToBudget(point_budget, false, downsampled);
+}
+
+double Downsampler::poissonDiskToBudget(size_t point_budget, PCLRichPointCloud& downsampled) const
+{
+  return searchToBudget(point_budget, true, downsampled);
+}
+
+// the points of a sampled surface go with 1/scale^2, which gives the next scale from the last count
+double Downsampler::searchToBudget(size_t point_budget, bool poisson_disk, PCLRichPointCloud& downsampled) const
+{
+  if (point_cloud_.size() <= point_budget)
+  {
+    downsampled = point_cloud_;
+    return 0.0;
+  }
+
+  double dx = max_[0]-min_[0], dy = max_[1]-min_[1], dz = max_[2]-min_[2];
+  double area = dx*dy+dy*dz+dz*dx;
+  double scale = std::sqrt(area/std::max(point_budget, size_t(1)));
+  if (!(scale > 0))
+    scale = 1.0;
+
+  std::vector<size_t> order;
+  if (poisson_disk)
+    getPoissonDiskOrder(order);
+
+  // aiming a bit under the budget, the counts just over it would otherwise take tiny steps
+  double target = (1.0-budget_tolerance/2)*point_budget;
+  double best_scale = 0.0, candidate_scale = scale;
+  PCLRichPointCloud candidate;
+  for (int i = 0; i < max_search_iterations; ++ i)
+  {
+    candidate_scale = scale;
+    if (poisson_disk)
+      poissonDisk(scale, order, candidate);
+    else
+      voxelGrid(scale, candidate);
+
+    size_t count = candidate.size();
+    if (count <= point_budget && (best_scale == 0.0 || count > downsampled.size()))
+    {
+      downsampled.swap(candidate);
+      best_scale = scale;
+    }
+    if (count <= point_budget && count >= (1.0-budget_tolerance)*point_budget)
+      break;
+
+    double factor = (count == 0)?(0.5):(std::sqrt(count/std::max(target, 1.0)));
+    scale *= std::min(std::max(factor, 0.5), 2.0);
+  }
+
+  // more points than the budget after all the iterations is better than none
+  if (best_scale == 0.0)
+  {
+    downsampled.swap(candidate);
+    best_scale = candidate_scale;
+  }
+
+  return best_scale;
+}
@@ -2,7 +2,10 @@
 #include <QColor>
 #include <QMutexLocker>
 #include <QColorDialog>
+#include <QRunnable>
+#include <QThreadPool>
 #include <QFutureWatcher>
+#include <QFutureInterface>
 #include <QtConcurrentRun>
 
 #include <osg/Group>
@@ -10,6 +13,7 @@
 
 #include "main_window.h"
 #include "point_cloud.h"
+#include "compact_point_cloud.h"
 #include "parameter_manager.h"
 #include "osg_viewer_widget.h"
 #include "file_system_model.h"
@@ -18,7 +22,9 @@
 FileSystemModel::FileSystemModel()
   :start_frame_(-1),
   end_frame_(-1),
-  view_number_(-1)
+  view_number_(-1),
+  compact_cache_age_(0),
+  compact_cache_size_(0)
 {
   setNameFilterDisables(false);
   QStringList allowed_file_extensions;
@@ -45,6 +51,12 @@ QVariant FileSystemModel::data(const QModelIndex &index, int role) const
     return computeCheckState(index);
   else
   {
+    if (role == Qt::DisplayRole)
+    {
+      LoadingWatcherMap::const_iterator it = loading_watchers_.find(index);
+      if (it != loading_watchers_.end())
+        return QString("%1 (loading %2%)").arg(QFileSystemModel::data(index, role).toString()).arg(it.value()->progressValue());
+    }
     if(role == Qt::ForegroundRole && checkRegisterState(index))
       return QBrush(QColor(255, 0, 0));
     return QFileSystemModel::data(index, role);
@@ -122,21 +134,76 @@ void FileSystemModel::limitPointCloudCacheSize(void)
 {
   size_t threshold = 128;
 
-  if (point_cloud_cache_map_.size() <= threshold)
-    return;
-
-  std::set<osg::ref_ptr<PointCloud> > in_use_clouds;
   std::vector<osg::ref_ptr<PointCloud> > freeable_clouds;
+  {
+    QMutexLocker locker(&mutex_);
 
-  for (PointCloudMap::const_iterator it = point_cloud_map_.begin(); it != point_cloud_map_.end(); ++ it)
-    in_use_clouds.insert(*it);
+    if (point_cloud_cache_map_.size() <= threshold)
+      return;
 
-  for (PointCloudCacheMap::const_iterator it = point_cloud_cache_map_.begin(); it != point_cloud_cache_map_.end(); ++ it)
-    if (in_use_clouds.find(it->second) == in_use_clouds.end() && it->second->referenceCount() == 1)
-      freeable_clouds.push_back(it->second);
+    std::set<osg::ref_ptr<PointCloud> > in_use_clouds;
+    for (PointCloudMap::const_iterator it = point_cloud_map_.begin(); it != point_cloud_map_.end(); ++ it)
+      in_use_clouds.insert(*it);
 
+    for (PointCloudCacheMap::const_iterator it = point_cloud_cache_map_.begin(); it != point_cloud_cache_map_.end(); ++ it)
+      if (in_use_clouds.find(it->second) == in_use_clouds.end() && it->second->referenceCount() == 1)
+        freeable_clouds.push_back(it->second);
+
+    // out of the cache they can not be handed out anymore, a request meanwhile opens the file again
+    for (size_t i = 0, i_end = freeable_clouds.size(); i < i_end; ++ i)
+      point_cloud_cache_map_.erase(freeable_clouds[i]->getFilename());
+  }
+
+  // encoded without the lock, so the other clouds can be fetched meanwhile
+  std::vector<CompactCacheEntry> entries(freeable_clouds.size());
   for (size_t i = 0, i_end = freeable_clouds.size(); i < i_end; ++ i)
-    point_cloud_cache_map_.erase(freeable_clouds[i]->getFilename());
+  {
+    QFileInfo fileinfo(freeable_clouds[i]->getFilename().c_str());
+    if (!fileinfo.exists())
+      continue;
+
+    CompactCacheEntry& entry = entries[i];
+    entry.points.reset(new CompactPointCloud);
+    entry.points->encode(*freeable_clouds[i]);
+    entry.last_modified = fileinfo.lastModified();
+    entry.file_size = fileinfo.size();
+    entry.memory_size = entry.points->getMemorySize();
+  }
+
+  QMutexLocker locker(&mutex_);
+  for (size_t i = 0, i_end = freeable_clouds.size(); i < i_end; ++ i)
+    if (entries[i].points)
+      addCompactPointCloud(freeable_clouds[i]->getFilename(), entries[i]);
+
+  return;
+}
+
+void FileSystemModel::addCompactPointCloud(const std::string& filename, const CompactCacheEntry& entry)
+{
+  // in bytes, about 384 scans of 200k points
+  size_t threshold = size_t(1) << 30;
+
+  CompactCacheMap::iterator replaced = compact_cache_map_.find(filename);
+  if (replaced != compact_cache_map_.end())
+  {
+    compact_cache_size_ -= replaced->second.memory_size;
+    compact_cache_map_.erase(replaced);
+  }
+
+  CompactCacheEntry& added_entry = compact_cache_map_[filename];
+  added_entry = entry;
+  added_entry.age = compact_cache_age_ ++;
+  compact_cache_size_ += added_entry.memory_size;
+
+  while (compact_cache_size_ > threshold && !compact_cache_map_.empty())
+  {
+    CompactCacheMap::iterator oldest = compact_cache_map_.begin();
+    for (CompactCacheMap::iterator it = compact_cache_map_.begin(); it != compact_cache_map_.end(); ++ it)
+      if (it->second.age < oldest->second.age)
+        oldest = it;
+    compact_cache_size_ -= oldest->second.memory_size;
+    compact_cache_map_.erase(oldest);
+  }
 
   return;
 }
@@ -169,34 +236,142 @@ std::string FileSystemModel::getImagesFolder(int frame, int view)
 
 osg::ref_ptr<PointCloud> FileSystemModel::getPointCloud(const std::string& filename)
 {
-  QMutexLocker locker(&mutex_);
+  return getPointCloud(filename, NULL);
+}
 
+osg::ref_ptr<PointCloud> FileSystemModel::getPointCloud(const std::string& filename, QFutureInterfaceBase* future)
+{
   limitPointCloudCacheSize();
 
-  QFileInfo fileinfo(filename.c_str());
-  if (!fileinfo.exists() || !fileinfo.isFile())
-    return NULL;
+  std::shared_ptr<CompactPointCloud> compact_points;
+  {
+    QMutexLocker locker(&mutex_);
 
-  PointCloudCacheMap::iterator it = point_cloud_cache_map_.find(filename);
-  if (it != point_cloud_cache_map_.end())
-    return it->second.get();
+    QFileInfo fileinfo(filename.c_str());
+    if (!fileinfo.exists() || !fileinfo.isFile())
+      return NULL;
+
+    PointCloudCacheMap::iterator it = point_cloud_cache_map_.find(filename);
+    if (it != point_cloud_cache_map_.end())
+      return it->second.get();
 
+    CompactCacheMap::iterator compact_it = compact_cache_map_.find(filename);
+    if (compact_it != compact_cache_map_.end())
+    {
+      const CompactCacheEntry& entry = compact_it->second;
+      if (entry.last_modified == fileinfo.lastModified() && entry.file_size == fileinfo.size())
+        compact_points = entry.points;
+      compact_cache_size_ -= entry.memory_size;
+      compact_cache_map_.erase(compact_it);
+    }
+  }
+
+  // opened without the lock, so the other clouds can be fetched meanwhile
   osg::ref_ptr<PointCloud> point_cloud(new PointCloud());
-  if (!point_cloud->open(filename))
+  bool opened = compact_points && point_cloud->open(filename, *compact_points);
+  if (!opened && !point_cloud->open(filename, future))
     return NULL;
 
   if (point_cloud->thread() != qApp->thread())
     point_cloud->moveToThread(qApp->thread());
 
+  // a canceled open belongs to a workspace that has been closed meanwhile, it is not cached
+  if (future != NULL && future->isCanceled())
+    return point_cloud;
+
+  QMutexLocker locker(&mutex_);
+
+  // the file may have been opened by another thread meanwhile, the cloud cached first is kept
+  PointCloudCacheMap::iterator it = point_cloud_cache_map_.find(filename);
+  if (it != point_cloud_cache_map_.end())
+    return it->second.get();
+
   point_cloud_cache_map_[filename] = point_cloud;
 
   return point_cloud;
 }
 
+// opens a cloud on the thread pool like QtConcurrent::run, but with a future that has
+// a progress and can be canceled
+class OpenPointCloudTask : public QRunnable
+{
+public:
+  OpenPointCloudTask(FileSystemModel* model, const std::string& filename)
+    :model_(model), filename_(filename)
+  {}
+
+  QFuture<osg::ref_ptr<PointCloud> > start(void)
+  {
+    future_interface_.setProgressRange(0, 100);
+    future_interface_.reportStarted();
+    QFuture<osg::ref_ptr<PointCloud> > future = future_interface_.future();
+    QThreadPool::globalInstance()->start(this);
+
+    return future;
+  }
+
+  virtual void run(void)
+  {
+    osg::ref_ptr<PointCloud> point_cloud;
+    if (!future_interface_.isCanceled())
+      point_cloud = model_->getPointCloud(filename_, &future_interface_);
+
+    future_interface_.setProgressValue(100);
+    future_interface_.reportResult(point_cloud);
+    future_interface_.reportFinished();
+
+    return;
+  }
+
+private:
+  FileSystemModel*                                    model_;
+  std::string                                         filename_;
+  QFutureInterface<osg::ref_ptr<PointCloud> >         future_interface_;
+};
+
+QFuture<osg::ref_ptr<PointCloud> > FileSystemModel::getPointCloudAsync(const std::string& filename)
+{
+  {
+    QMutexLocker locker(&mutex_);
+
+    PointCloudCacheMap::iterator it = point_cloud_cache_map_.find(filename);
+    if (it != point_cloud_cache_map_.end())
+    {
+      QFutureInterface<osg::ref_ptr<PointCloud> > future_interface;
+      future_interface.reportStarted();
+      future_interface.reportResult(it->second);
+      future_interface.reportFinished();
+      return future_interface.future();
+    }
+  }
+
+  // deleted by the thread pool once it has run
+  OpenPointCloudTask* task = new OpenPointCloudTask(this, filename);
+
+  return task->start();
+}
+
+// a canceled future may have no result
+static osg::ref_ptr<PointCloud> getResult(const QFuture<osg::ref_ptr<PointCloud> >& future)
+{
+  return (future.resultCount() > 0)?(future.result()):(osg::ref_ptr<PointCloud>());
+}
+
 QModelIndex FileSystemModel::setRootPath ( const QString & newPath )
 {
-  point_cloud_cache_map_.clear();
-  point_cloud_map_.clear();
+  // the clouds still being opened are dropped when they finish
+  for (LoadingWatcherMap::iterator it = loading_watchers_.begin(); it != loading_watchers_.end(); ++ it)
+    it.value()->cancel();
+  loading_watchers_.clear();
+
+  // the canceled opens may still be filling the caches
+  {
+    QMutexLocker locker(&mutex_);
+    point_cloud_cache_map_.clear();
+    compact_cache_map_.clear();
+    compact_cache_size_ = 0;
+    point_cloud_map_.clear();
+  }
   checked_indexes_.clear();
 
   QModelIndex index = QFileSystemModel::setRootPath(newPath);
@@ -416,22 +591,73 @@ void FileSystemModel::showPointCloud(const QPersistentModelIndex& index)
 {
   checked_indexes_.insert(index);
 
-  osg::ref_ptr<PointCloud> point_cloud(getPointCloud(filePath(index).toStdString()));
-  if (!point_cloud.valid())
+  if (point_cloud_map_.contains(index) || loading_watchers_.contains(index))
     return;
 
-  PointCloudMap::iterator point_cloud_map_it = point_cloud_map_.find(index);
-  if (point_cloud_map_it != point_cloud_map_.end())
+  // cached clouds are shown at once, the others when they have been opened off the GUI thread
+  QFuture<osg::ref_ptr<PointCloud> > future = getPointCloudAsync(filePath(index).toStdString());
+  if (future.isFinished())
+  {
+    addPointCloud(index, getResult(future));
+    return;
+  }
+
+  LoadingWatcher* watcher = new LoadingWatcher(this);
+  connect(watcher, SIGNAL(progressValueChanged(int)), this, SLOT(updateLoadingProgress()));
+  connect(watcher, SIGNAL(finished()), this, SLOT(finishLoading()));
+  loading_watchers_[index] = watcher;
+  watcher->setFuture(future);
+
+  emit dataChanged(index, index);
+
+  return;
+}
+
+void FileSystemModel::addPointCloud(const QPersistentModelIndex& index, osg::ref_ptr<PointCloud> point_cloud)
+{
+  if (!point_cloud.valid() || point_cloud_map_.contains(index))
     return;
 
   MainWindow::getInstance()->getOSGViewerWidget()->addChild(point_cloud);
-  point_cloud_map_[index] = point_cloud;
+  {
+    // read by limitPointCloudCacheSize() on the thread pool
+    QMutexLocker locker(&mutex_);
+    point_cloud_map_[index] = point_cloud;
+  }
 
   showPointCloudSceneInformation();
 
   return;
 }
 
+void FileSystemModel::updateLoadingProgress(void)
+{
+  QPersistentModelIndex index = loading_watchers_.key(static_cast<LoadingWatcher*>(sender()));
+  if (index.isValid())
+    emit dataChanged(index, index);
+
+  return;
+}
+
+void FileSystemModel::finishLoading(void)
+{
+  LoadingWatcher* watcher = static_cast<LoadingWatcher*>(sender());
+  watcher->deleteLater();
+
+  QPersistentModelIndex index = loading_watchers_.key(watcher);
+  if (!index.isValid())
+    return;
+  loading_watchers_.remove(index);
+
+  // unchecked while it was opened
+  if (checked_indexes_.contains(index) && !watcher->isCanceled())
+    addPointCloud(index, getResult(watcher->future()));
+
+  emit dataChanged(index, index);
+
+  return;
+}
+
 void FileSystemModel::hidePointCloud(const std::string& filename)
 {
   QModelIndex index = this->index(QString(filename.c_str()));
@@ -450,12 +676,19 @@ void FileSystemModel::hidePointCloud(const QPersistentModelIndex& index)
 {
   checked_indexes_.remove(index);
 
+  LoadingWatcherMap::iterator loading_it = loading_watchers_.find(index);
+  if (loading_it != loading_watchers_.end())
+    loading_it.value()->cancel();
+
   PointCloudMap::iterator point_cloud_map_it = point_cloud_map_.find(index);
   if (point_cloud_map_it == point_cloud_map_.end())
     return;
 
   MainWindow::getInstance()->getOSGViewerWidget()->removeChild(point_cloud_map_it.value().get());
-  point_cloud_map_.erase(point_cloud_map_it);
+  {
+    QMutexLocker locker(&mutex_);
+    point_cloud_map_.erase(point_cloud_map_it);
+  }
 
   showPointCloudSceneInformation();
 
@@ -476,7 +709,10 @@ void FileSystemModel::hideAndShowPointCloud(int hide_frame, int hide_view, int s
   if (point_cloud_map_it == point_cloud_map_.end())
   {
     if (show_cloud != NULL)
+    {
+      QMutexLocker locker(&mutex_);
       point_cloud_map_[show_index] = show_cloud;
+    }
     else
       to_show = false;
   }
@@ -487,7 +723,10 @@ void FileSystemModel::hideAndShowPointCloud(int hide_frame, int hide_view, int s
   checked_indexes_.remove(hide_index);
   point_cloud_map_it = point_cloud_map_.find(hide_index);
   if (point_cloud_map_it != point_cloud_map_.end())
+  {
+    QMutexLocker locker(&mutex_);
     point_cloud_map_.erase(point_cloud_map_it);
+  }
   else
     to_hide = false;
 
@@ -0,0 +1,224 @@
+#include <cmath>
+#include <vector>
+
+#include <QtConcurrentMap>
+#include <Eigen/Geometry>
+#include <Eigen/Eigenvalues>
+
+#include "image_grid.h"
+#include "grid_normal_estimator.h"
+
+// count, sums of x y z and of xx xy xz yy yz zz
+static const int moment_number = 10;
+
+// rows of the image per task
+static const int band_rows = 32;
+
+static void addMoments(const PCLRichPoint& point, double sign, double* moments)
+{
+  double x = point.x, y = point.y, z = point.z;
+  moments[0] += sign;
+  moments[1] += sign*x;
+  moments[2] += sign*y;
+  moments[3] += sign*z;
+  moments[4] += sign*x*x;
+  moments[5] += sign*x*y;
+  moments[6] += sign*x*z;
+  moments[7] += sign*y*y;
+  moments[8] += sign*y*z;
+  moments[9] += sign*z*z;
+
+  return;
+}
+
+static void addRow(const ImageGrid& image_grid, const PCLRichPointCloud& point_cloud, int y, double sign,
+  std::vector<double>& columns)
+{
+  if (y < 0 || y >= image_grid.getHeight())
+    return;
+
+  for (int x = 0, x_end = image_grid.getWidth(); x < x_end; ++ x)
+  {
+    int point = image_grid.getPoint(x, y);
+    if (point >= 0)
+      addMoments(point_cloud.points[point], sign, &columns[moment_number*x]);
+  }
+
+  return;
+}
+
+static void addColumn(const std::vector<double>& columns, int x, double sign, double* window)
+{
+  if (x < 0 || x >= (int)(columns.size()/moment_number))
+    return;
+
+  const double* column = &columns[moment_number*x];
+  for (int i = 0; i < moment_number; ++ i)
+    window[i] += sign*column[i];
+
+  return;
+}
+
+static void setViewDirection(PCLRichPoint& point)
+{
+  float length = std::sqrt(point.x*point.x+point.y*point.y+point.z*point.z);
+  float scale = (length > 0)?(-1.0f/length):(0.0f);
+  point.normal_x = point.x*scale;
+  point.normal_y = point.y*scale;
+  point.normal_z = point.z*scale;
+
+  return;
+}
+
+static void setNormal(const double* window, PCLRichPoint& point)
+{
+  double count = window[0];
+  if (count < 3)
+  {
+    setViewDirection(point);
+    return;
+  }
+
+  Eigen::Vector3d mean(window[1]/count, window[2]/count, window[3]/count);
+  Eigen::Matrix3d covariance;
+  covariance << window[4]/count, window[5]/count, window[6]/count,
+    window[5]/count, window[7]/count, window[8]/count,
+    window[6]/count, window[8]/count, window[9]/count;
+  covariance -= mean*mean.transpose();
+
+  // the normal is the eigenvector of the smallest eigenvalue l0, which is the dominant one of the
+  // adjugate with the eigenvalues l1*l2 >= l0*l2 >= l0*l1, so powering the adjugate converges by
+  // l0/l1 per power, several times cheaper than an eigen solver per point
+  Eigen::Matrix3d adjugate;
+  adjugate.col(0) = covariance.col(1).cross(covariance.col(2));
+  adjugate.col(1) = covariance.col(2).cross(covariance.col(0));
+  adjugate.col(2) = covariance.col(0).cross(covariance.col(1));
+  int column;
+  double scale = adjugate.colwise().squaredNorm().maxCoeff(&column);
+  if (!(scale > 0))
+  {
+    setViewDirection(point);
+    return;
+  }
+  adjugate /= std::sqrt(scale);
+  Eigen::Matrix3d adjugate_2 = adjugate*adjugate;
+  Eigen::Matrix3d adjugate_4 = adjugate_2*adjugate_2;
+  Eigen::Vector3d normal = adjugate_4*(adjugate_2*adjugate.col(column));
+  double length = normal.norm();
+  if (!(length > 0))
+  {
+    setViewDirection(point);
+    return;
+  }
+  normal /= length;
+
+  // l0 close to l1 leaves it unconverged, these few points are solved exactly
+  Eigen::Vector3d image = adjugate*normal;
+  Eigen::Vector3d residual = image-normal.dot(image)*normal;
+  if (!(residual.squaredNorm() <= 1e-6*image.squaredNorm()))
+  {
+    Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> solver;
+    solver.computeDirect(covariance);
+    normal = solver.eigenvectors().col(0);
+  }
+
+  // towards the camera at the origin
+  if (normal.x()*point.x+normal.y()*point.y+normal.z()*point.z > 0)
+    normal = -normal;
+
+  point.normal_x = (float)normal.x();
+  point.normal_y = (float)normal.y();
+  point.normal_z = (float)normal.z();
+
+  return;
+}
+
+GridNormalEstimator::GridNormalEstimator(const ImageGrid& image_grid, int radius)
+  :image_grid_(image_grid),
+  radius_(radius)
+{
+}
+
+GridNormalEstimator::~GridNormalEstimator(void)
+{
+}
+
+void GridNormalEstimator::computeRows(int row_begin, int row_end, PCLRichPointCloud& point_cloud) const
+{
+  int width = image_grid_.getWidth();
+  int radius = radius_;
+
+  // moments of the 2*radius+1 rows around the current row, per column
+  std::vector<double> columns(moment_number*width, 0.0);
+  for (int y = row_begin-radius; y < row_begin+radius; ++ y)
+    addRow(image_grid_, point_cloud, y, 1.0, columns);
+
+  for (int y = row_begin; y < row_end; ++ y)
+  {
+    addRow(image_grid_, point_cloud, y+radius, 1.0, columns);
+    if (y > row_begin)
+      addRow(image_grid_, point_cloud, y-radius-1, -1.0, columns);
+
+    double window[moment_number] = {0};
+    for (int x = 0; x < radius; ++ x)
+      addColumn(columns, x, 1.0, window);
+
+    for (int x = 0; x < width; ++ x)
+    {
+      addColumn(columns, x+radius, 1.0, window);
+      addColumn(columns, x-radius-1, -1.0, window);
+
+      int point = image_grid_.getPoint(x, y);
+      if (point >= 0)
+        setNormal(window, point_cloud.points[point]);
+    }
+  }
+
+  return;
+}
+
+class GridNormalBand
+{
+public:
+  typedef void result_type;
+
+  GridNormalBand(const GridNormalEstimator& estimator, PCLRichPointCloud& point_cloud)
+    :estimator_(estimator), point_cloud_(point_cloud)
+  {}
+
+  void operator()(const std::pair<int, int>& band) const
+  {
+    estimator_.computeRows(band.first, band.second, point_cloud_);
+
+    return;
+  }
+
+private:
+  const GridNormalEstimator&  estimator_;
+  PCLRichPointCloud&          point_cloud_;
+};
+
+void GridNormalEstimator::compute(PCLRichPointCloud& point_cloud) const
+{
+  if (image_grid_.getPointNumber() != point_cloud.size())
+    return;
+
+  std::vector<std::pair<int, int> > bands;
+  for (int row_begin = 0, height = image_grid_.getHeight(); row_begin < height; row_begin += band_rows)
+    bands.push_back(std::make_pair(row_begin, std::min(row_begin+band_rows, height)));
+  QtConcurrent::blockingMap(bands, GridNormalBand(*this, point_cloud));
+
+  // points sharing a pixel with another one take its normal
+  for (size_t i = 0, i_end = point_cloud.size(); i < i_end; ++ i)
+  {
+    int point = image_grid_.getPoint(image_grid_.getX(i), image_grid_.getY(i));
+    if (point >= 0 && point != (int)(i))
+    {
+      point_cloud.points[i].normal_x = point_cloud.points[point].normal_x;
+      point_cloud.points[i].normal_y = point_cloud.points[point].normal_y;
+      point_cloud.points[i].normal_z = point_cloud.points[point].normal_z;
+    }
+  }
+
+  return;
+}
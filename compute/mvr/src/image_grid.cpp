@@ -0,0 +1,128 @@
+#include <fstream>
+#include <algorithm>
+
+#include "image_grid.h"
+
+ImageGrid::ImageGrid(void)
+  :width_(0),
+  height_(0)
+{
+}
+
+ImageGrid::ImageGrid(int width, int height, size_t point_number)
+  :width_(width),
+  height_(height),
+  pixels_(point_number, 0),
+  grid_(size_t(width)*height, -1)
+{
+}
+
+ImageGrid::~ImageGrid(void)
+{
+}
+
+static const char grid_magic[4] = {'G', 'R', 'I', 'D'};
+
+bool ImageGrid::load(const std::string& filename)
+{
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  if (!fin.good())
+    return false;
+
+  char magic[4];
+  int width, height;
+  unsigned int point_number;
+  fin.read(magic, sizeof(magic));
+  fin.read((char*)(&width), sizeof(width));
+  fin.read((char*)(&height), sizeof(height));
+  fin.read((char*)(&point_number), sizeof(point_number));
+  if (!fin.good() || !std::equal(magic, magic+4, grid_magic) || width <= 0 || height <= 0)
+    return false;
+
+  std::vector<int> pixels(point_number);
+  if (point_number > 0 && !fin.read((char*)(&pixels[0]), point_number*sizeof(int)))
+    return false;
+
+  int pixel_number = width*height;
+  for (size_t i = 0; i < point_number; ++ i)
+    if (pixels[i] < 0 || pixels[i] >= pixel_number)
+      return false;
+
+  width_ = width;
+  height_ = height;
+  pixels_.swap(pixels);
+  buildGrid();
+
+  return true;
+}
+
+bool ImageGrid::save(const std::string& filename) const
+{
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  if (!fout.good())
+    return false;
+
+  unsigned int point_number = (unsigned int)(pixels_.size());
+  fout.write(grid_magic, sizeof(grid_magic));
+  fout.write((const char*)(&width_), sizeof(width_));
+  fout.write((const char*)(&height_), sizeof(height_));
+  fout.write((const char*)(&point_number), sizeof(point_number));
+  if (point_number > 0)
+    fout.write((const char*)(&pixels_[0]), point_number*sizeof(int));
+
+  return fout.good();
+}
+
+void ImageGrid::setPixel(size_t point, int x, int y)
+{
+  x = std::min(std::max(x, 0), width_-1);
+  y = std::min(std::max(y, 0), height_-1);
+
+  int pixel = y*width_+x;
+  pixels_[point] = pixel;
+  if (grid_[pixel] < 0)
+    grid_[pixel] = (int)(point);
+
+  return;
+}
+
+void ImageGrid::getNeighbors(size_t point, int radius, std::vector<int>& neighbors) const
+{
+  neighbors.clear();
+
+  int x = getX(point), y = getY(point);
+  int x_begin = std::max(x-radius, 0), x_end = std::min(x+radius+1, width_);
+  int y_begin = std::max(y-radius, 0), y_end = std::min(y+radius+1, height_);
+  for (int j = y_begin; j < y_end; ++ j)
+  {
+    const int* row = &grid_[j*width_];
+    for (int i = x_begin; i < x_end; ++ i)
+      if (row[i] >= 0 && row[i] != (int)(point))
+        neighbors.push_back(row[i]);
+  }
+
+  return;
+}
+
+void ImageGrid::compact(const std::vector<unsigned char>& keep)
+{
+  size_t kept = 0;
+  for (size_t i = 0, i_end = std::min(keep.size(), pixels_.size()); i < i_end; ++ i)
+    if (keep[i])
+      pixels_[kept++] = pixels_[i];
+  pixels_.resize(kept);
+
+  buildGrid();
+
+  return;
+}
+
+void ImageGrid::buildGrid(void)
+{
+  grid_.assign(size_t(width_)*height_, -1);
+  for (size_t i = 0, i_end = pixels_.size(); i < i_end; ++ i)
+    if (grid_[pixels_[i]] < 0)
+      grid_[pixels_[i]] = (int)(i);
+
+  return;
+}
@@ -129,17 +129,18 @@ void MainWindow::init(void)
   connect(ui_.actionICP, SIGNAL(triggered()), registrator_, SLOT(registrationICP()));
   connect(ui_.actionRefineAxis, SIGNAL(triggered()), registrator_, SLOT(refineAxis()));
   connect(ui_.actionGenerateObject, SIGNAL(triggered()), registrator_, SLOT(registration()));
+  connect(ui_.actionBenchmarkSearch, SIGNAL(triggered()), registrator_, SLOT(benchmarkSearch()));
 
   //batch tasks menu
   connect(ui_.actionPointCloudGeneration, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskPointsGeneration()));
   connect(ui_.actionRegistrationProcess, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskRegistration()));
   connect(ui_.actionDenoise, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskDenoise())); 
-//  connect(ui_.actionDenoise, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskDenoiseBySerialOrder()));
   connect(ui_.actionExtractImages, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskExtractImages()));
   connect(ui_.actionDataCut, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskDataCut()));
   connect(ui_.actionDownsampling, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskDownsampling()));
   connect(ui_.actionExtractPoints, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskExtractPoints()));
   connect(ui_.actionRemoveOutliers, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskRemoveOutliers()));
+  connect(ui_.actionCrop, SIGNAL(triggered()), task_dispatcher_, SLOT(dispatchTaskCrop()));
 
   loadSettings();
 
@@ -0,0 +1,115 @@
+#include <algorithm>
+
+#include <QtConcurrentMap>
+
+#include "neighbor_graph.h"
+
+// points per task
+static const size_t block_size = 4096;
+
+NeighborGraph::NeighborGraph(Type type, double size)
+  :type_(type),
+  size_(size),
+  offsets_(1, 0)
+{
+}
+
+bool NeighborGraph::covers(Type type, double size) const
+{
+  return type == type_ && size <= size_;
+}
+
+size_t NeighborGraph::getKNearestNumber(size_t i, int k) const
+{
+  return std::min(getDegree(i), size_t(std::max(k, 0)));
+}
+
+size_t NeighborGraph::getRadiusNumber(size_t i, double radius) const
+{
+  const float* squared_distances = getSquaredDistances(i);
+  float squared_radius = (float)(radius*radius);
+
+  return std::upper_bound(squared_distances, squared_distances+getDegree(i), squared_radius)-squared_distances;
+}
+
+// the rows of a block of points, concatenated into the graph in block order afterwards
+struct GraphBlock
+{
+  size_t              begin;
+  size_t              end;
+  std::vector<size_t> degrees;
+  std::vector<int>    neighbors;
+  std::vector<float>  squared_distances;
+};
+
+class BuildGraphBlock
+{
+public:
+  typedef void result_type;
+
+  BuildGraphBlock(const SearchBackend<PCLRichPoint>& search, NeighborGraph::Type type, double size)
+    :search_(search), type_(type), size_(size)
+  {}
+
+  void operator()(GraphBlock& block) const
+  {
+    const PCLRichPointCloud& cloud = *search_.getInputCloud();
+    std::vector<int> indices;
+    std::vector<float> squared_distances;
+
+    block.degrees.resize(block.end-block.begin);
+    for (size_t i = block.begin; i < block.end; ++ i)
+    {
+      int num = (type_ == NeighborGraph::K_NEAREST)?
+        (search_.nearestKSearch(cloud.points[i], (int)(size_), indices, squared_distances)):
+        (search_.radiusSearch(cloud.points[i], size_, indices, squared_distances));
+      num = std::max(num, 0);
+
+      block.degrees[i-block.begin] = num;
+      block.neighbors.insert(block.neighbors.end(), indices.begin(), indices.begin()+num);
+      block.squared_distances.insert(block.squared_distances.end(), squared_distances.begin(), squared_distances.begin()+num);
+    }
+
+    return;
+  }
+
+private:
+  const SearchBackend<PCLRichPoint>&  search_;
+  NeighborGraph::Type                 type_;
+  double                              size_;
+};
+
+NeighborGraph::ConstPtr NeighborGraph::build(const SearchBackend<PCLRichPoint>& search, Type type, double size)
+{
+  boost::shared_ptr<NeighborGraph> graph(new NeighborGraph(type, size));
+
+  size_t point_num = search.getInputCloud()->size();
+  std::vector<GraphBlock> blocks((point_num+block_size-1)/block_size);
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+  {
+    blocks[i].begin = i*block_size;
+    blocks[i].end = std::min(blocks[i].begin+block_size, point_num);
+  }
+  QtConcurrent::blockingMap(blocks, BuildGraphBlock(search, type, size));
+
+  size_t edge_num = 0;
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+    edge_num += blocks[i].neighbors.size();
+
+  graph->offsets_.reserve(point_num+1);
+  graph->neighbors_.reserve(edge_num);
+  graph->squared_distances_.reserve(edge_num);
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+  {
+    GraphBlock& block = blocks[i];
+    for (size_t j = 0, j_end = block.degrees.size(); j < j_end; ++ j)
+      graph->offsets_.push_back(graph->offsets_.back()+block.degrees[j]);
+    graph->neighbors_.insert(graph->neighbors_.end(), block.neighbors.begin(), block.neighbors.end());
+    graph->squared_distances_.insert(graph->squared_distances_.end(), block.squared_distances.begin(), block.squared_distances.end());
+    std::vector<size_t>().swap(block.degrees);
+    std::vector<int>().swap(block.neighbors);
+    std::vector<float>().swap(block.squared_distances);
+  }
+
+  return graph;
+}
@@ -0,0 +1,195 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "overlap_filter.h"
+
+// bits of a cell coordinate in its key
+static const int key_bits = 21;
+static const int64_t key_mask = (int64_t(1) << key_bits)-1;
+static const double key_max = double(key_mask);
+
+static inline bool isFinite(const PCLPoint& point)
+{
+  return pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z);
+}
+
+// the coordinates are shifted by one, so the ring of dilated cells below the cloud has keys too
+static inline uint64_t packKey(int64_t x, int64_t y, int64_t z)
+{
+  return (uint64_t(x+1) << (2*key_bits)) | (uint64_t(y+1) << key_bits) | uint64_t(z+1);
+}
+
+OverlapFilter::OverlapFilter(const PCLPointCloud& cloud, double distance)
+  :distance_(distance),
+  has_sector_(false),
+  cell_size_(1.0)
+{
+  buildCells(cloud, distance);
+}
+
+OverlapFilter::OverlapFilter(const PCLPointCloud& cloud, double distance, const Eigen::Vector3f& pivot_point,
+  const Eigen::Vector3f& axis_normal)
+  :distance_(distance),
+  has_sector_(false),
+  cell_size_(1.0)
+{
+  buildCells(cloud, distance);
+  buildSector(cloud, pivot_point, axis_normal);
+}
+
+OverlapFilter::~OverlapFilter(void)
+{
+}
+
+void OverlapFilter::buildCells(const PCLPointCloud& cloud, double distance)
+{
+  for (int i = 0; i < 3; ++ i)
+  {
+    min_[i] = std::numeric_limits<float>::max();
+    dimensions_[i] = 0;
+  }
+  float max[3] = {-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max()};
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    const PCLPoint& point = cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    const float position[3] = {point.x, point.y, point.z};
+    for (int j = 0; j < 3; ++ j)
+    {
+      min_[j] = std::min(min_[j], position[j]);
+      max[j] = std::max(max[j], position[j]);
+    }
+  }
+  if (min_[0] > max[0])
+    return;
+
+  double extent = 0.0;
+  for (int i = 0; i < 3; ++ i)
+    extent = std::max(extent, double(max[i]-min_[i]));
+
+  // one ring of cells covers the distance as long as the cells are not smaller than it,
+  // they only grow past it for clouds too wide for the keys
+  cell_size_ = std::max(distance, extent/(key_max-3));
+  if (cell_size_ <= 0.0)
+    cell_size_ = 1.0;
+  for (int i = 0; i < 3; ++ i)
+    dimensions_[i] = (int64_t)((max[i]-min_[i])/cell_size_)+1;
+
+  std::unordered_set<uint64_t> occupied_cells;
+  uint64_t key;
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+    if (isFinite(cloud.points[i]) && getKey(cloud.points[i].x, cloud.points[i].y, cloud.points[i].z, key))
+      occupied_cells.insert(key);
+
+  cells_.reserve(occupied_cells.size()*4);
+  for (std::unordered_set<uint64_t>::const_iterator it = occupied_cells.begin(); it != occupied_cells.end(); ++ it)
+  {
+    int64_t x = int64_t(*it >> (2*key_bits))-1;
+    int64_t y = (int64_t(*it >> key_bits) & key_mask)-1;
+    int64_t z = (int64_t(*it) & key_mask)-1;
+    for (int64_t dx = -1; dx <= 1; ++ dx)
+      for (int64_t dy = -1; dy <= 1; ++ dy)
+        for (int64_t dz = -1; dz <= 1; ++ dz)
+          cells_.insert(packKey(x+dx, y+dy, z+dz));
+  }
+
+  return;
+}
+
+void OverlapFilter::buildSector(const PCLPointCloud& cloud, const Eigen::Vector3f& pivot_point, const Eigen::Vector3f& axis_normal)
+{
+  if (!(axis_normal.norm() > 0.0f))
+    return;
+  Eigen::Vector3d axis = axis_normal.cast<double>().normalized();
+  Eigen::Vector3d pivot = pivot_point.cast<double>();
+
+  // the mean direction of the points from the axis is inside the sector if it is less than half a turn
+  Eigen::Vector3d reference = Eigen::Vector3d::Zero();
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    if (!isFinite(cloud.points[i]))
+      continue;
+    Eigen::Vector3d radial = cloud.points[i].getVector3fMap().cast<double>()-pivot;
+    radial -= radial.dot(axis)*axis;
+    double length = radial.norm();
+    if (length > 0.0)
+      reference += radial/length;
+  }
+  if (!(reference.norm() > 0.0))
+    return;
+  reference.normalize();
+  Eigen::Vector3d side = axis.cross(reference);
+
+  double min_angle = 0.0, max_angle = 0.0, max_radius = 0.0;
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    if (!isFinite(cloud.points[i]))
+      continue;
+    Eigen::Vector3d radial = cloud.points[i].getVector3fMap().cast<double>()-pivot;
+    double angle = std::atan2(radial.dot(side), radial.dot(reference));
+    min_angle = std::min(min_angle, angle);
+    max_angle = std::max(max_angle, angle);
+    max_radius = std::max(max_radius, radial.norm());
+  }
+  // two half spaces only bound a sector of less than half a turn, with a margin for the rounding
+  if (max_angle-min_angle >= M_PI-1e-3)
+    return;
+
+  // the normals point into the sector, a point within the distance of it is at most the distance
+  // outside of either plane
+  Eigen::Vector3d normals[2] = {-std::sin(min_angle)*reference+std::cos(min_angle)*side,
+    std::sin(max_angle)*reference-std::cos(max_angle)*side};
+  for (int i = 0; i < 2; ++ i)
+  {
+    for (int j = 0; j < 3; ++ j)
+      sector_normals_[i][j] = float(normals[i](j));
+    // widened a little more for the rounding of the float test
+    sector_offsets_[i] = float(distance_-normals[i].dot(pivot)+1e-5*(pivot.norm()+max_radius+distance_));
+  }
+  has_sector_ = true;
+
+  return;
+}
+
+bool OverlapFilter::getKey(float x, float y, float z, uint64_t& key) const
+{
+  const float position[3] = {x, y, z};
+  int64_t coordinates[3];
+  for (int i = 0; i < 3; ++ i)
+  {
+    double coordinate = std::floor((position[i]-min_[i])/cell_size_);
+    // beyond the dilated cells, also keeps far points from overflowing the keys
+    if (coordinate < -1.0 || coordinate > double(dimensions_[i]))
+      return false;
+    coordinates[i] = (int64_t)(coordinate);
+  }
+  key = packKey(coordinates[0], coordinates[1], coordinates[2]);
+
+  return true;
+}
+
+bool OverlapFilter::contains(const PCLPoint& point) const
+{
+  uint64_t key;
+  if (cells_.empty() || !isFinite(point))
+    return false;
+  for (int i = 0; has_sector_ && i < 2; ++ i)
+    if (sector_normals_[i][0]*point.x+sector_normals_[i][1]*point.y+sector_normals_[i][2]*point.z+sector_offsets_[i] < 0.0f)
+      return false;
+  if (!getKey(point.x, point.y, point.z, key))
+    return false;
+
+  return cells_.find(key) != cells_.end();
+}
+
+void OverlapFilter::filter(const PCLPointCloud& cloud, PCLPointCloud& filtered_cloud) const
+{
+  filtered_cloud.clear();
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+    if (contains(cloud.points[i]))
+      filtered_cloud.push_back(cloud.points[i]);
+
+  return;
+}
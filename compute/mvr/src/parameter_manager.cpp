@@ -12,16 +12,26 @@
 ParameterManager::ParameterManager(void)
   :registration_max_iterations_(new IntParameter("Max Iterations", "Max Iterations", 100, 1, 100,1)),
   registration_max_distance_(new DoubleParameter("Max Distance", "Max Distance", 4, 1, 16, 1.0)),
+  grid_search_(new BoolParameter("Grid Search", "Answer the neighbor queries with a hashed grid instead of a kd-tree", false)),
   start_frame_(new IntParameter("Start frame", "Start frame", -1, -1, -1, 1)),
   end_frame_(new IntParameter("End frame", "End frame", -1, -1, -1, 1)),
   current_frame_(new IntParameter("Current frame", "Current frame", -1, -1, -1, 1)),
   repeat_times_(new IntParameter("Repeat times", "Repeat times", 5, 1, 1000, 1)),
   generator_ctr_threshold_(new IntParameter("CTR Threshold", "CTR Threshold", 25, 1, 255, 1)),
   generator_sat_threshold_(new IntParameter("SAT Threshold", "SAT Threshold", 500, 1, 1000, 1)),
+  generator_bilinear_color_(new BoolParameter("Bilinear Color", "Interpolate the snapshot color bilinearly", false)),
+  generator_fused_generation_(new BoolParameter("Fused Generation", "Write points.pcd without the points.bxyzuv intermediate", true)),
+  generator_keep_decode_maps_(new BoolParameter("Keep Decode Maps", "Keep decode_maps.bin, a few MB per view, so a threshold change does not decode the images again", true)),
+  generator_normal_radius_(new IntParameter("Normal Radius", "Pixel radius of the normal estimation window, 0 for view directions", 2, 0, 8, 1)),
+  crop_by_plane_(new BoolParameter("Cut by Plane", "Crop the points below the plane of the rotation axis", true)),
+  crop_by_sphere_(new BoolParameter("Remove by Sphere", "Crop the points inside the sphere ball", true)),
   triangle_length_(new DoubleParameter("Triangle Length", "Triangle Length", 2.5, 1.0, 8.0, 0.1)),
   segment_threshold_(new IntParameter("Segment Threshold", "Segment Threshold", 10, 10, 500, 10)),
+  component_denoise_(new BoolParameter("Component Denoise", "Drop the components under the segment threshold, with the points within the triangle length linked, instead of the density outliers", false)),
   view_number_(new IntParameter("View Number", "View Number", 0, 0, 20, 1)),
   sample_ratio_(new IntParameter("Sample Ratio", "Sample Ratio", 10, 10, 1000, 10)),
+  point_budget_(new IntParameter("Point Budget", "Points to keep, 0 for the number of points divided by the sample ratio", 0, 0, 10000000, 10000)),
+  poisson_disk_(new BoolParameter("Poisson Disk", "Keep points a radius apart instead of the voxel grid centroids", false)),
   interval_(new IntParameter("Interval", "Interval", 5, 1, 30, 1))
 
 {
@@ -66,6 +76,11 @@ double ParameterManager::getRegistrationMaxDistance(void) const
   return *registration_max_distance_;
 }
 
+bool ParameterManager::getGridSearch(void) const
+{
+  return *grid_search_;
+}
+
 void ParameterManager::addFrameParameters(ParameterDialog* parameter_dialog, bool with_frames)
 {
   if (!with_frames)
@@ -106,23 +121,33 @@ void ParameterManager::getFrameparametersImpl(int& start_frame, int& end_frame,
   return;
 }
 
-bool ParameterManager::getGenerationParameters(int& ctr_threshold, int& sat_threshold)
+bool ParameterManager::getGenerationParameters(int& ctr_threshold, int& sat_threshold, bool& bilinear_color, bool& fused_generation,
+	bool& keep_decode_maps, int& normal_radius)
 {
 	int place_holder_1, place_holder_2;
-	return getGenerationParameters(ctr_threshold, sat_threshold, place_holder_1, place_holder_2, false);
+	return getGenerationParameters(ctr_threshold, sat_threshold, bilinear_color, fused_generation, keep_decode_maps, normal_radius,
+		place_holder_1, place_holder_2, false);
 }
-bool ParameterManager::getGenerationParameters(int& ctr_threshold, int& sat_threshold,
-	int& start_frame, int& end_frame, bool with_frames)
+bool ParameterManager::getGenerationParameters(int& ctr_threshold, int& sat_threshold, bool& bilinear_color, bool& fused_generation,
+	bool& keep_decode_maps, int& normal_radius, int& start_frame, int& end_frame, bool with_frames)
 {
 	ParameterDialog parameter_dialog("Points Generation Parameters", MainWindow::getInstance());
 	parameter_dialog.addParameter(generator_ctr_threshold_);
 	parameter_dialog.addParameter(generator_sat_threshold_);
+	parameter_dialog.addParameter(generator_bilinear_color_);
+	parameter_dialog.addParameter(generator_fused_generation_);
+	parameter_dialog.addParameter(generator_keep_decode_maps_);
+	parameter_dialog.addParameter(generator_normal_radius_);
 	addFrameParameters(&parameter_dialog, with_frames);
 	if (!parameter_dialog.exec() == QDialog::Accepted)
 		return false;
 
 	ctr_threshold = *generator_ctr_threshold_;
 	sat_threshold = *generator_sat_threshold_;
+	bilinear_color = *generator_bilinear_color_;
+	fused_generation = *generator_fused_generation_;
+	keep_decode_maps = *generator_keep_decode_maps_;
+	normal_radius = *generator_normal_radius_;
 	getFrameparametersImpl(start_frame, end_frame, with_frames);
 
 	return true;
@@ -142,6 +167,7 @@ bool ParameterManager::getRegistrationLUMParameters(int& segment_threshold, int&
   ParameterDialog parameter_dialog("Registration Parameters", MainWindow::getInstance());
   parameter_dialog.addParameter(registration_max_iterations_);
   parameter_dialog.addParameter(registration_max_distance_);
+  parameter_dialog.addParameter(grid_search_);
   parameter_dialog.addParameter(segment_threshold_);
   addFrameParameters(&parameter_dialog, with_frames);
   if (!parameter_dialog.exec() == QDialog::Accepted)
@@ -160,6 +186,7 @@ bool ParameterManager::getRegistrationLUMParameters(int& segment_threshold, int&
   ParameterDialog parameter_dialog("Registration Parameters", MainWindow::getInstance());
   parameter_dialog.addParameter(registration_max_iterations_);
   parameter_dialog.addParameter(registration_max_distance_);
+  parameter_dialog.addParameter(grid_search_);
   parameter_dialog.addParameter(segment_threshold_);
   parameter_dialog.addParameter(current_frame_);
   if (!parameter_dialog.exec() == QDialog::Accepted)
@@ -211,10 +238,14 @@ bool ParameterManager::getRegistrationParameters(int& frame, int& segment_thresh
   return true;
 }
 
-bool ParameterManager::getDenoiseParameters(int& segment_threshold, int& start_frame, int& end_frame, bool with_frames)
+bool ParameterManager::getDenoiseParameters(int& segment_threshold, double& triangle_length, bool& component_denoise,
+	int& start_frame, int& end_frame, bool with_frames)
 {
 	ParameterDialog parameter_dialog("Denoise Parameters", MainWindow::getInstance());
 	parameter_dialog.addParameter(segment_threshold_);
+	parameter_dialog.addParameter(component_denoise_);
+	parameter_dialog.addParameter(triangle_length_);
+	parameter_dialog.addParameter(grid_search_);
 	parameter_dialog.addParameter(start_frame_);
 	parameter_dialog.addParameter(end_frame_);
 	addFrameParameters(&parameter_dialog, with_frames);
@@ -222,6 +253,8 @@ bool ParameterManager::getDenoiseParameters(int& segment_threshold, int& start_f
 		return false;
 
 	segment_threshold = *segment_threshold_;
+	triangle_length = *triangle_length_;
+	component_denoise = *component_denoise_;
 	start_frame = *start_frame_;
 	end_frame = *end_frame_;
 	getFrameparametersImpl(start_frame, end_frame, with_frames);
@@ -261,6 +294,22 @@ bool ParameterManager::getRemoveOutliersParameters(int& start_frame, int& end_fr
 	return true;
 }
 
+bool ParameterManager::getCropParameters(bool& by_plane, bool& by_sphere, int& start_frame, int& end_frame, bool with_frames)
+{
+	ParameterDialog parameter_dialog("Crop Parameters", MainWindow::getInstance());
+	parameter_dialog.addParameter(crop_by_plane_);
+	parameter_dialog.addParameter(crop_by_sphere_);
+	addFrameParameters(&parameter_dialog, with_frames);
+	if (!parameter_dialog.exec() == QDialog::Accepted)
+		return false;
+
+	by_plane = *crop_by_plane_;
+	by_sphere = *crop_by_sphere_;
+	getFrameparametersImpl(start_frame, end_frame, with_frames);
+
+	return true;
+}
+
 bool ParameterManager::getExtractImagesParameters(int& view_number, int& start_frame, int& end_frame, bool with_frames)
 {
 	ParameterDialog parameter_dialog("Extract Images Parameters", MainWindow::getInstance());
@@ -279,10 +328,13 @@ bool ParameterManager::getExtractImagesParameters(int& view_number, int& start_f
 	return true;
 }
 
-bool ParameterManager::getDownsamplingParameters(int& sample_ratio, int& start_frame, int& end_frame, bool with_frames)
+bool ParameterManager::getDownsamplingParameters(int& sample_ratio, int& point_budget, bool& poisson_disk,
+	int& start_frame, int& end_frame, bool with_frames)
 {
 	ParameterDialog parameter_dialog("Downsampling Parameters", MainWindow::getInstance());
 	parameter_dialog.addParameter(sample_ratio_);
+	parameter_dialog.addParameter(point_budget_);
+	parameter_dialog.addParameter(poisson_disk_);
 	parameter_dialog.addParameter(start_frame_);
 	parameter_dialog.addParameter(end_frame_);
 	addFrameParameters(&parameter_dialog, with_frames);
@@ -290,6 +342,8 @@ bool ParameterManager::getDownsamplingParameters(int& sample_ratio, int& start_f
 		return false;
 
 	sample_ratio = *sample_ratio_;
+	point_budget = *point_budget_;
+	poisson_disk = *poisson_disk_;
 	start_frame = *start_frame_;
 	end_frame = *end_frame_;
 	getFrameparametersImpl(start_frame, end_frame, with_frames);
@@ -6,6 +6,7 @@
 #include <QColorDialog>
 #include <QFutureWatcher>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
 
 #include <osg/Geode>
 #include <osg/io_utils>
@@ -14,18 +15,13 @@
 #include <osgManipulator/TrackballDragger>
 #include <osgManipulator/TranslateAxisDragger>
 
-//#include <CGAL/Delaunay_triangulation_3.h>
-//#include <CGAL/Triangulation_vertex_base_with_info_3.h>
-//#include <CGAL/Exact_predicates_inexact_constructions_kernel.h>
-
-#include <boost/graph/adjacency_list.hpp>
-#include <boost/graph/connected_components.hpp>
-
-#include <pcl/io/pcd_io.h>
-#include <pcl/io/ply_io.h>
-
-
 #include "parameter.h"
+#include "crop_engine.h"
+#include "point_cloud_data.h"
+#include "compact_point_cloud.h"
+#include "search_backend.h"
+#include "neighbor_graph.h"
+#include "connected_components.h"
 #include "registrator.h"
 #include "sphere_ball.h"
 #include "main_window.h"
@@ -41,11 +37,12 @@ PointCloud::PointCloud(void)
   trackball_dragger_(new osgManipulator::TrackballDragger),
   show_draggers_(false),
   registered_(false),
-//  triangulation_(new CGAL::Delaunay()),
-  point_graph_(new boost::PointGraph()),
-  point_graph_threshold_(-1.0),
   points_num_(0),
-  noise_points_num_(0)
+  noise_points_num_(0),
+  points_version_(0),
+  decoded_(false),
+  transformed_version_(0),
+  neighborhood_version_(0)
 {
   translate_dragger_->setupDefaultGeometry();
   translate_dragger_->setHandleEvents(true);
@@ -66,8 +63,6 @@ PointCloud::PointCloud(void)
 
 PointCloud::~PointCloud(void)
 {
-//  delete triangulation_;
-//  delete point_graph_;
 }
 
 void PointCloud::setRegisterState(bool registered)
@@ -79,53 +74,86 @@ void PointCloud::setRegisterState(bool registered)
   return;
 }
 
-bool PointCloud::open(const std::string& filename)
+bool PointCloud::open(const std::string& filename, QFutureInterfaceBase* future)
 {
+  PCLRichPointCloud point_cloud;
+  ImageGrid image_grid;
+  if (!PointCloudData::load(filename, point_cloud, image_grid, future))
+    return false;
+
   clearData();
 
   QMutexLocker locker(&mutex_);
 
-  if (pcl::io::loadPCDFile(filename, *this) != 0)
-    return false;
-
+  PCLRichPointCloud::swap(point_cloud);
+  image_grid_ = image_grid;
   filename_ = filename;
+  decoded_ = false;
   loadTransformation();
 
   registered_ = (getView() == 0) || (!(getMatrix().isIdentity()));
+  points_version_ ++;
  
   expire();
 
   return true;
 }
 
-bool PointCloud::save(const std::string& filename)
+bool PointCloud::open(const std::string& filename, const CompactPointCloud& compact_points)
 {
-  if (QString(filename.c_str()).right(3) == "ply")
-  {
-    PCLPointCloud point_cloud;
-    osg::Vec3 pivot_point(-13.382786, 50.223461, 917.477600);
-    osg::Vec3 axis_normal(-0.054323, -0.814921, -0.577020);
-    osg::Matrix transformation = osg::Matrix::translate(-pivot_point)*osg::Matrix::rotate(axis_normal, osg::Vec3(0, 0, 1));
-    for (size_t i = 0; i < points_num_; ++ i)
-    {
-      osg::Vec3 point(at(i).x, at(i).y, at(i).z);
-      point = transformation.preMult(point);
-      point_cloud.push_back(PCLPoint(point.x(), point.y(), point.z()));     
-    }
-    pcl::PLYWriter ply_writer;
-    if (ply_writer.write<PCLPoint>(filename, point_cloud) != 0)
-      return false;
-  }
-  else
+  clearData();
+
+  QMutexLocker locker(&mutex_);
+
+  compact_points.decode(*this);
+  if (!image_grid_.load(PointCloudData::getGridFilename(filename)) || image_grid_.getPointNumber() != size())
+    image_grid_ = ImageGrid();
+
+  filename_ = filename;
+  decoded_ = true;
+  loadTransformation();
+
+  registered_ = (getView() == 0) || (!(getMatrix().isIdentity()));
+  points_version_ ++;
+
+  expire();
+
+  return true;
+}
+
+bool PointCloud::restoreExactPoints(void)
+{
+  if (!decoded_)
+    return true;
+
+  PCLRichPointCloud point_cloud;
+  ImageGrid image_grid;
+  if (!PointCloudData::load(filename_, point_cloud, image_grid) || point_cloud.size() != size())
   {
-    pcl::PCDWriter pcd_writer;
-    if (pcd_writer.writeBinaryCompressed<PCLRichPoint>(filename, *this) != 0)       
+    std::cout << "Restore points: " << filename_ << " does not fit its compact copy anymore" << std::endl;
     return false;
   }
 
+  QMutexLocker locker(&mutex_);
+
+  // the same points in the same order, so the noise marks and the image grid still apply
+  points.swap(point_cloud.points);
+  decoded_ = false;
+  points_version_ ++;
+
+  expire();
+
   return true;
 }
 
+bool PointCloud::save(const std::string& filename)
+{
+  if (!restoreExactPoints())
+    return false;
+
+  return PointCloudData::save(filename, *this, getImageGrid());
+}
+
 void PointCloud::save(void)
 {
   MainWindow* main_window = MainWindow::getInstance();
@@ -153,6 +181,13 @@ void PointCloud::clearData()
 
   Renderable::clear();
   PCLRichPointCloud::clear();
+  image_grid_ = ImageGrid();
+  noise_mask_.clear();
+  noise_points_num_ = 0;
+  points_version_ ++;
+  search_.reset();
+  k_nearest_graph_.reset();
+  radius_graph_.reset();
 
   return;
 }
@@ -298,21 +333,160 @@ void PointCloud::toggleRegisterState(void)
 }
 
 
-void PointCloud::getTransformedPoints(PCLPointCloud& points)
+// points per task of the batch transform
+static const size_t transform_block_size = 16384;
+
+// v*M with the division by w of osg::Matrix::preMult, in double like it, so the transformed
+// points are the same, but with the matrix in locals and a store per point the loop vectorizes
+class TransformBlock
 {
-  points.clear();
+public:
+  typedef void result_type;
 
-  const osg::Matrix& matrix = getMatrix();
-  for (size_t i = 0, i_end = size(); i < i_end; ++ i)
+  TransformBlock(const osg::Matrix& matrix, const PCLRichPoint* points, PCLPoint* transformed_points)
+    :matrix_(matrix), points_(points), transformed_points_(transformed_points)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
   {
-    osg::Vec3 point(at(i).x, at(i).y, at(i).z);
-    point = matrix.preMult(point);
-    points.push_back(PCLPoint(point.x(), point.y(), point.z()));
+    const osg::Matrix::value_type* m = matrix_.ptr();
+    const double m00 = m[0], m01 = m[1], m02 = m[2], m03 = m[3];
+    const double m10 = m[4], m11 = m[5], m12 = m[6], m13 = m[7];
+    const double m20 = m[8], m21 = m[9], m22 = m[10], m23 = m[11];
+    const double m30 = m[12], m31 = m[13], m32 = m[14], m33 = m[15];
+
+    for (size_t i = block.first, i_end = block.second; i < i_end; ++ i)
+    {
+      double x = points_[i].x, y = points_[i].y, z = points_[i].z;
+      double d = 1.0/(m03*x + m13*y + m23*z + m33);
+      PCLPoint& point = transformed_points_[i];
+      point.x = (float)((m00*x + m10*y + m20*z + m30)*d);
+      point.y = (float)((m01*x + m11*y + m21*z + m31)*d);
+      point.z = (float)((m02*x + m12*y + m22*z + m32)*d);
+      point.data[3] = 1.0f;
+    }
+
+    return;
   }
 
+private:
+  const osg::Matrix&  matrix_;
+  const PCLRichPoint* points_;
+  PCLPoint*           transformed_points_;
+};
+
+static void transformPoints(const PCLRichPointCloud& points, const osg::Matrix& matrix, PCLPointCloud& transformed_points)
+{
+  size_t point_num = points.size();
+  transformed_points.points.resize(point_num);
+  transformed_points.width = (uint32_t)(point_num);
+  transformed_points.height = 1;
+  transformed_points.is_dense = points.is_dense;
+
+  std::vector<std::pair<size_t, size_t> > blocks;
+  for (size_t i = 0; i < point_num; i += transform_block_size)
+    blocks.push_back(std::make_pair(i, std::min(i+transform_block_size, point_num)));
+  if (!blocks.empty())
+    QtConcurrent::blockingMap(blocks, TransformBlock(matrix, &points.points[0], &transformed_points.points[0]));
+
+  return;
+}
+
+PCLPointCloud::ConstPtr PointCloud::getTransformedPoints(void)
+{
+  QMutexLocker locker(&mutex_);
+
+  const osg::Matrix& matrix = getMatrix();
+  if (transformed_points_ && transformed_version_ == points_version_ && transformed_matrix_ == matrix)
+    return transformed_points_;
+
+  // the buffer is reused unless an earlier caller still holds it
+  if (!transformed_points_ || !transformed_points_.unique())
+    transformed_points_.reset(new PCLPointCloud);
+
+  transformPoints(*this, matrix, *transformed_points_);
+
+  transformed_matrix_ = matrix;
+  transformed_version_ = points_version_;
+
+  return transformed_points_;
+}
+
+void PointCloud::getTransformedPoints(PCLPointCloud& points)
+{
+  points = *getTransformedPoints();
+
   return;
 }
 
+PCLPointCloud::ConstPtr PointCloud::getLocalPoints(void)
+{
+  QMutexLocker locker(&mutex_);
+
+  PCLPointCloud::Ptr local_points(new PCLPointCloud);
+  transformPoints(*this, osg::Matrix::identity(), *local_points);
+
+  return local_points;
+}
+
+// the search indexes the cloud itself instead of a copy of it
+struct NullDeleter
+{
+  void operator()(const void*) const {}
+};
+
+const SearchBackend<PCLRichPoint>& PointCloud::getSearch(void)
+{
+  if (neighborhood_version_ != points_version_)
+  {
+    search_.reset();
+    k_nearest_graph_.reset();
+    radius_graph_.reset();
+    neighborhood_version_ = points_version_;
+  }
+
+  // the graphs do not depend on the backend, only the search is rebuilt when it is switched
+  SearchBackend<PCLRichPoint>::Type search_type = ParameterManager::getInstance().getGridSearch()?
+    (SearchBackend<PCLRichPoint>::GRID):(SearchBackend<PCLRichPoint>::KDTREE);
+  if (!search_ || search_->getType() != search_type)
+  {
+    search_ = SearchBackend<PCLRichPoint>::create(search_type);
+    search_->setInputCloud(PCLRichPointCloud::ConstPtr(this, NullDeleter()));
+  }
+
+  return *search_;
+}
+
+NeighborGraph::ConstPtr PointCloud::getNeighborGraph(NeighborGraph::Type type, double size)
+{
+  if (neighborhood_version_ != points_version_)
+    getSearch();
+
+  NeighborGraph::ConstPtr& graph = (type == NeighborGraph::K_NEAREST)?(k_nearest_graph_):(radius_graph_);
+  if (graph && graph->covers(type, size))
+    return graph;
+
+  graph = NeighborGraph::build(getSearch(), type, size);
+  std::cout << "Neighbor graph: frame " << getFrame() << " " << graph->getEdgeNumber() << " edges for "
+    << graph->getPointNumber() << " points" << std::endl;
+
+  return graph;
+}
+
+NeighborGraph::ConstPtr PointCloud::getKNearestGraph(int k)
+{
+  QMutexLocker locker(&mutex_);
+
+  return getNeighborGraph(NeighborGraph::K_NEAREST, k);
+}
+
+NeighborGraph::ConstPtr PointCloud::getRadiusGraph(double radius)
+{
+  QMutexLocker locker(&mutex_);
+
+  return getNeighborGraph(NeighborGraph::RADIUS, radius);
+}
+
 void PointCloud::loadTransformation(void)
 {
   std::string filename = (QFileInfo(filename_.c_str()).path()+"/transformation.txt").toStdString();
@@ -430,145 +604,204 @@ void PointCloud::initRotation(void)
 }
 
 
-//void PointCloud::denoise(int segment_threshold, double triangle_length)
-//{
-//  QMutexLocker locker(&mutex_);
-//  
-//  points_num_ = size();
-//  initPointGraph(ParameterManager::getInstance().getTriangleLength());
-//
-//  boost::PointGraph& g_point = *point_graph_;
-//  std::vector<boost::PointGraphTraits::vertex_descriptor> component(boost::num_vertices(g_point));
-//  size_t component_num = boost::connected_components(g_point, &component[0]);
-//
-//  std::vector<std::vector<boost::PointGraphTraits::vertex_descriptor> > components(component_num);
-//  for (size_t i = 0; i < points_num_; ++ i)
-//    components[component[i]].push_back(i);
-//  
-//
-//  for (size_t i = 0, i_end = components.size(); i < i_end; ++ i)
-//  {
-//    if (components[i].size() < segment_threshold)
-//    {	
-//      for (size_t j = 0, j_end = components[i].size(); j < j_end; ++ j)
-//		  indicateNoise(components[i][j]);
-//    }
-//  }
-//    
-//  triangulation_->clear();
-//  g_point.clear();
-//
-//  expire();
-//
-//  return;
-//}
-
-// this method is based on the paper -- Consolidation of Low-quality Point Clouds from Outdoor Scenes
-void PointCloud::denoise(int k)
+// the points closer than triangle_length are linked, the components with fewer than segment_threshold
+// points are noise, the same components as the short edges of the Delaunay triangulation gave, as
+// its edges hold the minimum spanning tree
+void PointCloud::denoise(int segment_threshold, double triangle_length)
 {
 	QMutexLocker locker(&mutex_);
 
-	const float w = 1.25;
-	std::vector<std::vector<int> > point_index;
-	std::vector<std::vector<float> > point_dist;
-
-	std::vector<float> d_k_vector;
-	std::vector<float> D_k_vector;
-	std::vector<float> DDF_k_vector;
-	std::vector<float> theta_k_vector;
-
-	pcl::KdTreeFLANN<PCLRichPoint> kdtree;
-	PointCloud::Ptr cloud(new PointCloud);
-	PointCloud::iterator itr = this->begin();
-	while (itr != this->end())
-	{
-		cloud->push_back(*itr);
-		itr ++;
-	}
-
-	kdtree.setInputCloud (cloud);
-
 	points_num_ = size();
+	if (points_num_ == 0)
+		return;
 
-	//K nearest neighbor search
+	std::vector<int> components;
+	std::vector<size_t> component_sizes;
+	size_t component_num = ConnectedComponents(*this, triangle_length).compute(components, component_sizes);
+
+	size_t noise_points_num = noise_points_num_;
 	for (size_t i = 0, i_end = points_num_; i < i_end; i ++)
 	{
-		const PCLRichPoint& search_point = at(i);
+		if (component_sizes[components[i]] < (size_t)(std::max(segment_threshold, 0)))
+			indicateNoise(i);
+	}
+	std::cout << "Component denoise: frame " << getFrame() << " marked " << noise_points_num_-noise_points_num
+		<< " of " << points_num_ << " points in " << component_num << " components" << std::endl;
 
-		std::vector<int> pointIdxNKNSearch(k);
-		std::vector<float> pointNKNSquaredDistance(k);
-		kdtree.nearestKSearch (search_point, k, pointIdxNKNSearch, pointNKNSquaredDistance);
+	expire();
 
-		for (std::vector<float>::iterator itr = pointNKNSquaredDistance.begin(); itr != pointNKNSquaredDistance.end(); itr++)
-		{
-			*itr = sqrt(*itr); 
-		}
+	return;
+}
 
-		point_index.push_back(pointIdxNKNSearch);
-		point_dist.push_back(pointNKNSquaredDistance);
+// blocks of points handed to the threads of the denoising passes
+typedef std::pair<size_t, size_t> PointBlock;
 
+// the mean distance d_k of every point of a block to its k nearest neighbors
+class DensityNeighbors
+{
+public:
+	typedef void result_type;
 
-		std::vector<float> dists = point_dist.at(i);
-		float sum = 0;
-		for (size_t j = 0, j_end = dists.size(); j < j_end; j ++)
+	DensityNeighbors(const NeighborGraph& graph, int k, std::vector<float>& d_k_vector)
+		:graph_(graph), k_(k), d_k_vector_(d_k_vector)
+	{}
+
+	void operator()(const PointBlock& block) const
+	{
+		for (size_t i = block.first; i < block.second; i ++)
 		{
-			sum += dists[j];
+			const float* dists = graph_.getSquaredDistances(i);
+			size_t dists_size = graph_.getKNearestNumber(i, k_);
+
+			float sum = 0;
+			for (size_t j = 0, j_end = dists_size; j < j_end; j ++)
+			{
+				sum += sqrt(dists[j]);
+			}
+			int num = dists_size;
+			d_k_vector_[i] = sum / num;
 		}
-		int num = dists.size();
-		d_k_vector.push_back(sum / num);
+
+		return;
 	}
 
-	for (size_t i = 0, i_end = points_num_; i < i_end; i ++)
-	{
-		std::vector<int> index = point_index.at(i);
-		float sum = 0;
+private:
+	const NeighborGraph&					graph_;
+	int										k_;
+	std::vector<float>&						d_k_vector_;
+};
+
+// the density of every point against the one of its neighbors, with the expressions
+// of the serial version so the same points are classified as noise
+class DensityOutliers
+{
+public:
+	typedef void result_type;
+
+	DensityOutliers(int k, float w, const NeighborGraph& graph,
+		const std::vector<float>& d_k_vector, std::vector<unsigned char>& noise_flags)
+		:k_(k), w_(w), graph_(graph), d_k_vector_(d_k_vector), noise_flags_(noise_flags)
+	{}
 
-		for (size_t j = 0, j_end = index.size(); j < j_end; j ++)
+	void operator()(const PointBlock& block) const
+	{
+		for (size_t i = block.first; i < block.second; i ++)
 		{
-			sum += d_k_vector.at(index[j]);
+			const int* index = graph_.getNeighbors(i);
+			size_t index_size = graph_.getKNearestNumber(i, k_);
+
+			float sum = 0;
+			for (size_t j = 0, j_end = index_size; j < j_end; j ++)
+			{
+				sum += d_k_vector_[index[j]];
+			}
+			int num = index_size;
+
+			float D_k = sum / num;
+			float DDF_k = abs(1-d_k_vector_[i]/D_k);
+
+			sum = 0;
+			for (size_t j = 0, j_end = index_size; j < j_end; j ++)
+			{
+				sum += pow(d_k_vector_[index[j]] - D_k, 2);
+			}
+			float theta = sqrt(sum / index_size);
+			float theta_k = theta / D_k;
+
+			noise_flags_[i] = (DDF_k > theta_k * w_)?(1):(0);
 		}
-		int num = index.size();
 
-		D_k_vector.push_back(sum / num);
-		DDF_k_vector.push_back(abs(1-d_k_vector[i]/D_k_vector[i]));
+		return;
 	}
 
+private:
+	int									k_;
+	float								w_;
+	const NeighborGraph&				graph_;
+	const std::vector<float>&			d_k_vector_;
+	std::vector<unsigned char>&			noise_flags_;
+};
+
+// this method is based on the paper -- Consolidation of Low-quality Point Clouds from Outdoor Scenes
+void PointCloud::denoise(int k)
+{
+	QMutexLocker locker(&mutex_);
+
+	const float w = 1.25;
+	const size_t block_size = 4096;
+
+	points_num_ = size();
+	if (points_num_ == 0 || k <= 0)
+		return;
+
+	// shared with the other stages, a graph of more neighbors built before is reused
+	NeighborGraph::ConstPtr graph = getNeighborGraph(NeighborGraph::K_NEAREST, k);
+
+	std::vector<PointBlock> blocks;
+	for (size_t i = 0; i < points_num_; i += block_size)
+		blocks.push_back(PointBlock(i, std::min(i+block_size, points_num_)));
+
+	// the density statistics once every d_k is known
+	std::vector<float> d_k_vector(points_num_);
+	QtConcurrent::blockingMap(blocks, DensityNeighbors(*graph, k, d_k_vector));
+
+	std::vector<unsigned char> noise_flags(points_num_);
+	QtConcurrent::blockingMap(blocks, DensityOutliers(k, w, *graph, d_k_vector, noise_flags));
+
+	size_t noise_points_num = noise_points_num_;
 	for (size_t i = 0, i_end = points_num_; i < i_end; i ++)
 	{
-		std::vector<int> index = point_index.at(i);
-		float sum = 0;
-		for (size_t j = 0, j_end = index.size(); j < j_end; j ++)
-		{
-			sum += pow(d_k_vector[index[j]] - D_k_vector[i], 2);
-		}
-		float theta = sqrt(sum / index.size());
-		theta_k_vector.push_back(theta / D_k_vector[i]);
-
-		if (DDF_k_vector[i] > theta_k_vector[i] * w)
+		if (noise_flags[i])
 			indicateNoise(i);
 	}
+	std::cout << "Density denoise: frame " << getFrame() << " marked "
+		<< noise_points_num_-noise_points_num << " of " << points_num_ << " points" << std::endl;
 
 	expire();
 
 	return;
 }
 
-// remove by iterator
+// stable compaction of the points not marked as noise, in one pass
 void PointCloud::removeNoise()
 {
+	if (!restoreExactPoints())
+		return;
+
 	int frame = getFrame();
-	std::cout << "Denoise: frame " << frame << std::endl;
 
-	PointCloud::iterator itr = this->begin();
-	while (itr != this->end())
+	QMutexLocker locker(&mutex_);
+
+	size_t point_num = size();
+	if (getImageGrid() != NULL)
 	{
-		PCLRichPoint& point = *itr;
-		if (point.x == 0 && point.y == 0 && point.z == 0)
-			itr = this->erase(itr);
-		else
-			itr ++;
+		std::vector<unsigned char> keep(point_num);
+		for (size_t i = 0; i < point_num; ++ i)
+			keep[i] = isNoise(i)?(0):(1);
+		image_grid_.compact(keep);
 	}
 
+	size_t kept = 0;
+	for (size_t i = 0; i < point_num; ++ i)
+	{
+		if (isNoise(i))
+			continue;
+		if (kept != i)
+			points[kept] = points[i];
+		kept ++;
+	}
+	points.resize(kept);
+	width = (uint32_t)(kept);
+	height = 1;
+
+	noise_mask_.clear();
+	noise_points_num_ = 0;
+	points_version_ ++;
+	std::cout << "Remove noise: frame " << frame << " removed " << point_num-kept << " of " << point_num << " points" << std::endl;
+
+	expire();
+	locker.unlock();
+
 	FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
 	std::string folder = model->getPointsFolder(frame);
 	std::string filename = folder+"/points.pcd";
@@ -579,116 +812,62 @@ void PointCloud::removeNoise()
 
 void PointCloud::indicateNoise(size_t i)
 {
-	 // indicate special number to remove 
-	PCLRichPoint& point = at(i);
-	point.x = 0;
-	point.y = 0;
-	point.z = 0;
+	if (noise_mask_.size() != size())
+		noise_mask_.resize(size(), false);
+
+	if (!noise_mask_[i])
+	{
+		noise_mask_[i] = true;
+		noise_points_num_ ++;
+	}
 
 	return;
 }
 
-bool PointCloud::isNoise(size_t i)
+bool PointCloud::isNoise(size_t i) const
 {
-	PCLRichPoint& point = at(i);
-	if (point.x == 0 && point.y == 0 && point.z == 0)
-		return true;
-	return false;
+	return i < noise_mask_.size() && noise_mask_[i];
 }
 
 void PointCloud::extractByPlane()
 {
-	QMutexLocker locker(&mutex_);
-
 	Registrator* registrator = MainWindow::getInstance()->getRegistrator();
 	osg::Vec3 pivot_point = registrator->getPivotPoint();
 	osg::Vec3 axis_normal = registrator->getAxisNormal();
-	osg::Vec4 plane = osg::Plane(axis_normal, pivot_point).asVec4();
-	double a = plane.x();
-	double b = plane.y();
-	double c = plane.z();
-	double d = plane.w();
 
-	for (size_t i = 0, i_end = size();i < i_end; i++) 
-	{
-		const PCLRichPoint& point = at(i);
-		double check = a*point.x + b*point.y + c*point.z + d;
-		if (check <= 0)
-			indicateNoise(i);
-	}
-
-	locker.unlock();
+	CropEngine crop_engine;
+	crop_engine.addHalfSpace(osg::Plane(axis_normal, pivot_point).asVec4());
+	crop(crop_engine, "Extract by plane");
 
 	return;
 }
 
 void PointCloud::extractBySphere()
+{
+	SphereBall* sphere_ball = MainWindow::getInstance()->getSphereBall();
+
+	CropEngine crop_engine;
+	crop_engine.addSphere(sphere_ball->getCenter(), sphere_ball->getRadius());
+	crop(crop_engine, "Extract by sphere");
+
+	return;
+}
+
+void PointCloud::crop(const CropEngine& crop_engine, const std::string& stage)
 {
 	QMutexLocker locker(&mutex_);
 
-	SphereBall* sphere_ball = MainWindow::getInstance()->getSphereBall();
-	osg::Vec3 center = sphere_ball->getCenter();
-	double radius = sphere_ball->getRadius();
+	std::vector<unsigned char> flags;
+	crop_engine.evaluate(*this, flags);
 
-	for (size_t i = 0, i_end = size();i < i_end; i++) 
+	size_t noise_points_num = noise_points_num_;
+	for (size_t i = 0, i_end = flags.size(); i < i_end; i++)
 	{
-		const PCLRichPoint& point = at(i);
-		double check = pow(point.x-center.x(), 2) + pow(point.y-center.y(), 2) + pow(point.z-center.z(), 2) - radius*radius;
-		if (check <= 0)
+		if (flags[i])
 			indicateNoise(i);
 	}
-
-	locker.unlock();
+	std::cout << stage << ": frame " << getFrame() << " marked "
+		<< noise_points_num_-noise_points_num << " of " << size() << " points" << std::endl;
 
 	return;
 }
-
-//void PointCloud::initPointGraph(double distance_threshold)
-//{
-//  if (distance_threshold == point_graph_threshold_
-//    && boost::num_edges(*point_graph_) != 0)
-//    return;
-//
-//  triangulate();
-//  point_graph_threshold_ = distance_threshold;
-//
-//  boost::PointGraph& g_point = *point_graph_;
-//  g_point = boost::PointGraph(points_num_);
-//
-//  size_t t = 8;
-//
-//  for (CGAL::Delaunay::Finite_edges_iterator it = triangulation_->finite_edges_begin();
-//    it != triangulation_->finite_edges_end(); ++ it)
-//  {
-//    const CGAL::Delaunay::Cell_handle& cell_handle  = it->first;
-//    const CGAL::Delaunay::Vertex_handle& source_handle = cell_handle->vertex(it->second);
-//    const CGAL::Delaunay::Vertex_handle& target_handle = cell_handle->vertex(it->third);
-//    double distance_L1 = std::sqrt(CGAL::squared_distance(source_handle->point(), target_handle->point()));
-//    if (distance_L1 > point_graph_threshold_)
-//      continue;
-//
-//    size_t source_id = source_handle->info();
-//    size_t target_id = target_handle->info();
-//    assert (source_id < points_num_ && target_id < points_num_);
-//    WeightedEdge weighted_edge(distance_L1);
-//    boost::add_edge(source_id, target_id, weighted_edge, g_point);
-//  }
-//
-//  return;
-//}
-//
-//void PointCloud::triangulate() const
-//{
-//  if (triangulation_->number_of_vertices() != 0)
-//    return;
-//  
-//  for (size_t i = 0, i_end = points_num_; i < i_end; ++ i)
-//  {
-//    const PCLRichPoint& point = at(i);
-//    CGAL::Delaunay::Point delaunay_point(point.x, point.y, point.z);
-//    CGAL::Delaunay::Vertex_handle vertex_handle = triangulation_->insert(delaunay_point);
-//    vertex_handle->info() = i;
-//  }
-//  
-//  return;
-//}
\ No newline at end of file
@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <vector>
+#include <algorithm>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QString>
+#include <QFutureInterface>
+
+#include <osg/Matrix>
+
+#include <pcl/io/pcd_io.h>
+#include <pcl/io/ply_io.h>
+
+#include "point_cloud_data.h"
+
+PointCloudData::PointCloudData(void)
+{
+}
+
+PointCloudData::~PointCloudData(void)
+{
+}
+
+bool PointCloudData::open(const std::string& filename)
+{
+  if (!load(filename, *this, image_grid_))
+    return false;
+
+  filename_ = filename;
+
+  return true;
+}
+
+bool PointCloudData::save(const std::string& filename) const
+{
+  return save(filename, *this, getImageGrid());
+}
+
+std::string PointCloudData::getGridFilename(const std::string& filename)
+{
+  QFileInfo file_info(filename.c_str());
+
+  return (file_info.path()+"/"+file_info.completeBaseName()+".grid").toStdString();
+}
+
+// the file is read once in chunks, so the progress follows the disk and a cancel stops the read,
+// pcl then parses it from the file cache
+static bool readAhead(const std::string& filename, QFutureInterfaceBase* future)
+{
+  const qint64 chunk_size = 4*1024*1024;
+
+  QFile file(filename.c_str());
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  qint64 file_size = std::max(file.size(), qint64(1));
+  std::vector<char> chunk(chunk_size);
+  for (qint64 read_size = 0; ; )
+  {
+    if (future->isCanceled())
+      return false;
+
+    qint64 chunk_read_size = file.read(&chunk[0], chunk_size);
+    if (chunk_read_size <= 0)
+      break;
+    read_size += chunk_read_size;
+    future->setProgressValue((int)(PointCloudData::load_progress*read_size/file_size));
+  }
+
+  return true;
+}
+
+bool PointCloudData::load(const std::string& filename, PCLRichPointCloud& point_cloud, ImageGrid& image_grid,
+  QFutureInterfaceBase* future)
+{
+  if (future != NULL && !readAhead(filename, future))
+    return false;
+
+  if (pcl::io::loadPCDFile(filename, point_cloud) != 0)
+    return false;
+
+  if (future != NULL && future->isCanceled())
+    return false;
+
+  if (!image_grid.load(getGridFilename(filename)) || image_grid.getPointNumber() != point_cloud.size())
+    image_grid = ImageGrid();
+
+  return true;
+}
+
+bool PointCloudData::save(const std::string& filename, const PCLRichPointCloud& point_cloud, const ImageGrid* image_grid)
+{
+  if (QString(filename.c_str()).right(3) == "ply")
+  {
+    PCLPointCloud ply_cloud;
+    osg::Vec3 pivot_point(-13.382786, 50.223461, 917.477600);
+    osg::Vec3 axis_normal(-0.054323, -0.814921, -0.577020);
+    osg::Matrix transformation = osg::Matrix::translate(-pivot_point)*osg::Matrix::rotate(axis_normal, osg::Vec3(0, 0, 1));
+    for (size_t i = 0, i_end = point_cloud.size(); i < i_end; ++ i)
+    {
+      osg::Vec3 point(point_cloud.at(i).x, point_cloud.at(i).y, point_cloud.at(i).z);
+      point = transformation.preMult(point);
+      ply_cloud.push_back(PCLPoint(point.x(), point.y(), point.z()));
+    }
+    pcl::PLYWriter ply_writer;
+    if (ply_writer.write<PCLPoint>(filename, ply_cloud) != 0)
+      return false;
+  }
+  else
+  {
+    pcl::PCDWriter pcd_writer;
+    if (pcd_writer.writeBinaryCompressed<PCLRichPoint>(filename, point_cloud) != 0)
+      return false;
+
+    // keep the sidecar grid in step with the cloud, a stale one would map pixels to wrong points
+    std::string grid_filename = getGridFilename(filename);
+    if (image_grid != NULL)
+      image_grid->save(grid_filename);
+    else
+      std::remove(grid_filename.c_str());
+  }
+
+  return true;
+}
@@ -2,8 +2,10 @@
 
 #include <QFileDialog>
 #include <QMessageBox>
+#include <QElapsedTimer>
 #include <QFutureWatcher>
 #include <QtConcurrentRun>
+#include <QtConcurrentMap>
 
 #include <osg/Geode>
 #include <osg/Shape>
@@ -17,21 +19,22 @@
 #include <boost/numeric/ublas/matrix.hpp>
 #include <boost/bind.hpp>
 
-#include <pcl/kdtree/kdtree_flann.h>
 #include <pcl/registration/icp.h>
 #include <pcl/registration/lum.h>
-#include <pcl/registration/correspondence_estimation.h>
 
 
 #include "main_window.h"
 
 #include "point_cloud.h"
+#include "point_cloud_data.h"
 #include "math_solvers.h"
 #include "parameter_manager.h"
 #include "osg_viewer_widget.h"
 #include "file_system_model.h"
 #include "osg_utility.h"
 #include "color_map.h"
+#include "search_backend.h"
+#include "overlap_filter.h"
 #include "registrator.h"
 
 Registrator::Registrator(void)
@@ -332,7 +335,7 @@ void Registrator::saveRegisteredPoints(int frame)
   if (folder.empty())
     return;
 
-  PointCloud registered_points;
+  PointCloudData registered_points;
   for (size_t i = 0; i < view_number; ++ i)
   {
     osg::ref_ptr<PointCloud> point_cloud = model->getPointCloud(frame, i);
@@ -446,6 +449,140 @@ void Registrator::refineAxis(void)
   refineAxis(frame);
 }
 
+static SearchBackend<PCLPoint>::Type getSearchType(void)
+{
+  return ParameterManager::getInstance().getGridSearch()?(SearchBackend<PCLPoint>::GRID):(SearchBackend<PCLPoint>::KDTREE);
+}
+
+static SearchBackend<PCLPoint>::Ptr createSearch(const PCLPointCloud::ConstPtr& cloud, SearchBackend<PCLPoint>::Type type)
+{
+  SearchBackend<PCLPoint>::Ptr search = SearchBackend<PCLPoint>::create(type);
+  search->setInputCloud(cloud);
+
+  return search;
+}
+
+static Eigen::Vector3f toEigen(const osg::Vec3& vector)
+{
+  return Eigen::Vector3f(vector.x(), vector.y(), vector.z());
+}
+
+// the turntable axis in the frame of a cloud placed in the world by matrix
+static void getLocalAxis(const osg::Vec3& pivot_point, const osg::Vec3& axis_normal, const osg::Matrix& matrix,
+  Eigen::Vector3f& local_pivot_point, Eigen::Vector3f& local_axis_normal)
+{
+  osg::Matrix inverse = osg::Matrix::inverse(matrix);
+  local_pivot_point = toEigen(pivot_point*inverse);
+  local_axis_normal = toEigen(osg::Matrix::transform3x3(axis_normal, inverse));
+
+  return;
+}
+
+// builds the index of a view and the filter of its overlap with the others
+class BuildSearches
+{
+public:
+  typedef void result_type;
+
+  BuildSearches(const std::vector<PCLPointCloud::ConstPtr>& clouds, const std::vector<Eigen::Vector3f>& pivot_points,
+    const std::vector<Eigen::Vector3f>& axis_normals, SearchBackend<PCLPoint>::Type type, double max_distance,
+    std::vector<SearchBackend<PCLPoint>::Ptr>& searches, std::vector<OverlapFilter::ConstPtr>& overlaps)
+    :clouds_(clouds), pivot_points_(pivot_points), axis_normals_(axis_normals), type_(type),
+    max_distance_(max_distance), searches_(searches), overlaps_(overlaps)
+  {}
+
+  void operator()(size_t view) const
+  {
+    searches_[view] = createSearch(clouds_[view], type_);
+    overlaps_[view].reset(new OverlapFilter(*clouds_[view], max_distance_, pivot_points_[view], axis_normals_[view]));
+
+    return;
+  }
+
+private:
+  const std::vector<PCLPointCloud::ConstPtr>&   clouds_;
+  const std::vector<Eigen::Vector3f>&           pivot_points_;
+  const std::vector<Eigen::Vector3f>&           axis_normals_;
+  SearchBackend<PCLPoint>::Type                 type_;
+  double                                        max_distance_;
+  std::vector<SearchBackend<PCLPoint>::Ptr>&    searches_;
+  std::vector<OverlapFilter::ConstPtr>&         overlaps_;
+};
+
+struct ViewPair
+{
+  size_t                  source;
+  size_t                  target;
+  pcl::CorrespondencesPtr correspondences;
+};
+
+class EstimateCorrespondences
+{
+public:
+  typedef void result_type;
+
+  EstimateCorrespondences(const std::vector<SearchBackend<PCLPoint>::Ptr>& searches,
+    const std::vector<OverlapFilter::ConstPtr>& overlaps, const std::vector<osg::Matrix>& matrices, double max_distance)
+    :searches_(searches), overlaps_(overlaps), matrices_(matrices), max_distance_(max_distance)
+  {}
+
+  void operator()(ViewPair& view_pair) const
+  {
+    // the source points to the world, then to the frame of the target
+    osg::Matrix source_to_target = matrices_[view_pair.source]*osg::Matrix::inverse(matrices_[view_pair.target]);
+    Eigen::Matrix4f matrix = PclMatrixCaster<osg::Matrix>(source_to_target);
+    Eigen::Affine3f transformation(matrix);
+
+    view_pair.correspondences.reset(new pcl::Correspondences);
+    determineReciprocalCorrespondences(*searches_[view_pair.source], *searches_[view_pair.target],
+      transformation, max_distance_, *view_pair.correspondences, overlaps_[view_pair.target].get());
+
+    return;
+  }
+
+private:
+  const std::vector<SearchBackend<PCLPoint>::Ptr>&  searches_;
+  const std::vector<OverlapFilter::ConstPtr>&       overlaps_;
+  const std::vector<osg::Matrix>&                   matrices_;
+  double                                            max_distance_;
+};
+
+// indexes the clouds concurrently, with the filters of their overlaps for max_distance, and
+// the turntable axis in the frame of each cloud for the sectors of the filters
+static void buildSearches(const std::vector<PCLPointCloud::ConstPtr>& clouds, const std::vector<Eigen::Vector3f>& pivot_points,
+  const std::vector<Eigen::Vector3f>& axis_normals, double max_distance,
+  std::vector<SearchBackend<PCLPoint>::Ptr>& searches, std::vector<OverlapFilter::ConstPtr>& overlaps)
+{
+  std::vector<size_t> views(clouds.size());
+  for (size_t i = 0, i_end = views.size(); i < i_end; ++ i)
+    views[i] = i;
+  searches.assign(clouds.size(), SearchBackend<PCLPoint>::Ptr());
+  overlaps.assign(clouds.size(), OverlapFilter::ConstPtr());
+  QtConcurrent::blockingMap(views, BuildSearches(clouds, pivot_points, axis_normals, getSearchType(), max_distance, searches, overlaps));
+
+  return;
+}
+
+// the reciprocal correspondences of every view with the next one around the ring, the searches and
+// the overlaps are in the local frames of the views and the matrices place them in the world. The pairs
+// run concurrently on the global thread pool, so at most one thread per core is busy however many views there are
+static void estimateRingCorrespondences(const std::vector<SearchBackend<PCLPoint>::Ptr>& searches,
+  const std::vector<OverlapFilter::ConstPtr>& overlaps, const std::vector<osg::Matrix>& matrices,
+  double max_distance, std::vector<ViewPair>& view_pairs)
+{
+  size_t view_number = searches.size();
+
+  view_pairs.resize(view_number);
+  for (size_t i = 0; i < view_number; ++ i)
+  {
+    view_pairs[i].source = i;
+    view_pairs[i].target = (i==view_number-1)?(0):(i+1);
+  }
+  QtConcurrent::blockingMap(view_pairs, EstimateCorrespondences(searches, overlaps, matrices, max_distance));
+
+  return;
+}
+
 void Registrator::computeError(int frame)
 {
   error_vertices_->clear();
@@ -471,20 +608,33 @@ void Registrator::computeError(int frame)
   if (shown_flag[0] && shown_flag[last_view])
     neighbor_pairs.push_back(std::make_pair(0, last_view));
 
-  PCLPointCloud::Ptr source(new PCLPointCloud);
-  PCLPointCloud::Ptr target(new PCLPointCloud);
+  // every view is in two pairs, its index and the filter of its overlap are built once for both
+  double distance_threshold = ParameterManager::getInstance().getRegistrationMaxDistance();
+  SearchBackend<PCLPoint>::Type search_type = getSearchType();
+  Eigen::Vector3f pivot_point = toEigen(getPivotPoint());
+  Eigen::Vector3f axis_normal = toEigen(getAxisNormal());
+  std::vector<SearchBackend<PCLPoint>::Ptr> searches(view_number);
+  std::vector<OverlapFilter::ConstPtr> overlaps(view_number);
   for (size_t i = 0, i_end = neighbor_pairs.size(); i < i_end; ++ i)
   {
-    model->getPointCloud(frame, neighbor_pairs[i].first)->getTransformedPoints(*source);
-    model->getPointCloud(frame, neighbor_pairs[i].second)->getTransformedPoints(*target);
+    size_t views[2] = {neighbor_pairs[i].first, neighbor_pairs[i].second};
+    for (int j = 0; j < 2; ++ j)
+      if (!searches[views[j]])
+        searches[views[j]] = createSearch(model->getPointCloud(frame, views[j])->getTransformedPoints(), search_type);
+    if (!overlaps[views[1]])
+      overlaps[views[1]].reset(new OverlapFilter(*searches[views[1]]->getInputCloud(), distance_threshold, pivot_point, axis_normal));
+  }
 
-    pcl::registration::CorrespondenceEstimation<PCLPoint, PCLPoint, float> correspondence_estimation;
-    correspondence_estimation.setInputSource(source);
-    correspondence_estimation.setInputTarget(target);
+  for (size_t i = 0, i_end = neighbor_pairs.size(); i < i_end; ++ i)
+  {
+    const SearchBackend<PCLPoint>& source_search = *searches[neighbor_pairs[i].first];
+    const SearchBackend<PCLPoint>& target_search = *searches[neighbor_pairs[i].second];
+    PCLPointCloud::ConstPtr source = source_search.getInputCloud();
+    PCLPointCloud::ConstPtr target = target_search.getInputCloud();
 
-    double distance_threshold = ParameterManager::getInstance().getRegistrationMaxDistance();
     pcl::CorrespondencesPtr correspondences (new pcl::Correspondences);
-    correspondence_estimation.determineReciprocalCorrespondences(*correspondences, distance_threshold);
+    determineReciprocalCorrespondences(source_search, target_search, distance_threshold, *correspondences,
+      overlaps[neighbor_pairs[i].second].get());
 
     for (size_t i = 0, i_end = correspondences->size(); i < i_end; ++ i)
     {
@@ -550,7 +700,6 @@ void Registrator::registrationICP(int max_iterations, double max_distance, int f
   for (size_t i = 0, i_end = point_clouds.size(); i < i_end; ++ i)
     point_clouds[i]->initRotation();
 
-  PCLPointCloud::Ptr source(new PCLPointCloud);
   PCLPointCloud::Ptr target(new PCLPointCloud);
 
   pcl::IterativeClosestPoint<PCLPoint, PCLPoint> icp;
@@ -565,18 +714,30 @@ void Registrator::registrationICP(int max_iterations, double max_distance, int f
   icp.setEuclideanFitnessEpsilon(64);
 
   model->getPointCloud(frame, 0)->getTransformedPoints(*target);
+  Eigen::Vector3f pivot_point = toEigen(getPivotPoint());
+  Eigen::Vector3f axis_normal = toEigen(getAxisNormal());
   for (size_t i = 0, i_end = point_clouds.size(); i < i_end; ++ i)
   {
-    point_clouds[i]->getTransformedPoints(*source);
-    icp.setInputSource(source);
-    icp.setInputTarget(target);
-    PCLPointCloud transformed_source;
-    icp.align(transformed_source);
-   
-    osg::Matrix result_matrix = PclMatrixCaster<osg::Matrix>(icp.getFinalTransformation());
-    point_clouds[i]->setMatrix(point_clouds[i]->getMatrix()*result_matrix);
-
-    *target += transformed_source;
+    PCLPointCloud::ConstPtr source = point_clouds[i]->getTransformedPoints();
+
+    // only the overlap of the clouds is aligned, with a margin for the points the alignment
+    // moves into reach, the kd-trees of icp are built over it and the rest is never queried
+    PCLPointCloud::Ptr overlap_source(new PCLPointCloud);
+    PCLPointCloud::Ptr overlap_target(new PCLPointCloud);
+    OverlapFilter(*target, 2*max_distance, pivot_point, axis_normal).filter(*source, *overlap_source);
+    OverlapFilter(*source, 2*max_distance, pivot_point, axis_normal).filter(*target, *overlap_target);
+    if (!overlap_source->empty() && !overlap_target->empty())
+    {
+      icp.setInputSource(overlap_source);
+      icp.setInputTarget(overlap_target);
+      PCLPointCloud transformed_source;
+      icp.align(transformed_source);
+
+      osg::Matrix result_matrix = PclMatrixCaster<osg::Matrix>(icp.getFinalTransformation());
+      point_clouds[i]->setMatrix(point_clouds[i]->getMatrix()*result_matrix);
+    }
+
+    *target += *point_clouds[i]->getTransformedPoints();
   }
 
   if (show_error_)
@@ -629,15 +790,31 @@ void Registrator::registrationLUM(int segment_threshold, int max_iterations, dou
     point_cloud->setRegisterState(true);
   }
 
+  // LUM only changes the poses, so the views are indexed once in their own frames and the
+  // queries are moved between the frames instead
+  std::vector<PCLPointCloud::ConstPtr> local_clouds(view_number);
+  std::vector<Eigen::Vector3f> pivot_points(view_number), axis_normals(view_number);
+  for (size_t i = 0; i < view_number; ++ i)
+  {
+    osg::ref_ptr<PointCloud> point_cloud = model->getPointCloud(frame, i);
+    local_clouds[i] = point_cloud->getLocalPoints();
+    getLocalAxis(getPivotPoint(), getAxisNormal(), point_cloud->getMatrix(), pivot_points[i], axis_normals[i]);
+  }
+  std::vector<SearchBackend<PCLPoint>::Ptr> searches;
+  std::vector<OverlapFilter::ConstPtr> overlaps;
+  buildSearches(local_clouds, pivot_points, axis_normals, max_distance, searches, overlaps);
+
   int lum_max_iterations = 16;
   int outer_loop_num = std::max(1, max_iterations/lum_max_iterations);
   for (size_t loop = 0; loop < outer_loop_num; ++ loop)
   {
     pcl::registration::LUM<PCLPoint> lum;
+    std::vector<osg::Matrix> matrices(view_number);
     for (size_t i = 0; i < view_number; ++ i)
     {
       osg::ref_ptr<PointCloud> point_cloud = model->getPointCloud(frame, i);
       point_cloud->initRotation();
+      matrices[i] = point_cloud->getMatrix();
 
       PCLPointCloud::Ptr transformed_cloud(new PCLPointCloud);
       point_cloud->getTransformedPoints(*transformed_cloud);
@@ -646,18 +823,10 @@ void Registrator::registrationLUM(int segment_threshold, int max_iterations, dou
       
     }
 
-    for (size_t i = 0; i < view_number; ++ i)
-    {
-      int source_idx = i;
-      int target_idx = (i==view_number-1)?(0):(i+1);
-      pcl::registration::CorrespondenceEstimation<PCLPoint, PCLPoint, float> correspondence_estimation;
-      correspondence_estimation.setInputSource(lum.getPointCloud(source_idx));
-      correspondence_estimation.setInputTarget(lum.getPointCloud(target_idx));
-
-      pcl::CorrespondencesPtr correspondences(new pcl::Correspondences);
-      correspondence_estimation.determineReciprocalCorrespondences (*correspondences, max_distance);
-      lum.setCorrespondences(source_idx, target_idx, correspondences);
-    }
+    std::vector<ViewPair> view_pairs;
+    estimateRingCorrespondences(searches, overlaps, matrices, max_distance, view_pairs);
+    for (size_t i = 0, i_end = view_pairs.size(); i < i_end; ++ i)
+      lum.setCorrespondences(view_pairs[i].source, view_pairs[i].target, view_pairs[i].correspondences);
     
     lum.setMaxIterations(lum_max_iterations);
     lum.compute();
@@ -707,6 +876,149 @@ void Registrator::registrationLUM(void)
   return;
 }
 
+// the squared distance of the k-th nearest neighbor of every point of a block
+class KthNeighborDistances
+{
+public:
+  typedef void result_type;
+
+  KthNeighborDistances(const SearchBackend<PCLPoint>& search, int k, std::vector<float>& kth_distances)
+    :search_(search), k_(k), kth_distances_(kth_distances)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
+  {
+    const PCLPointCloud& cloud = *search_.getInputCloud();
+    std::vector<int> indices(k_);
+    std::vector<float> squared_distances(k_);
+    for (size_t i = block.first; i < block.second; ++ i)
+    {
+      int num = search_.nearestKSearch(cloud.points[i], k_, indices, squared_distances);
+      kth_distances_[i] = (num > 0)?(squared_distances[num-1]):(-1.0f);
+    }
+
+    return;
+  }
+
+private:
+  const SearchBackend<PCLPoint>&  search_;
+  int                             k_;
+  std::vector<float>&             kth_distances_;
+};
+
+void Registrator::benchmarkSearch(int frame)
+{
+  FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
+  int view_number = model->getViewNumber();
+  if (view_number < 2)
+    return;
+
+  const int k = 10;
+  const size_t block_size = 4096;
+  double max_distance = ParameterManager::getInstance().getRegistrationMaxDistance();
+
+  std::vector<PCLPointCloud::ConstPtr> clouds(view_number);
+  size_t point_num = 0;
+  for (size_t i = 0; i < view_number; ++ i)
+  {
+    clouds[i] = model->getPointCloud(frame, i)->getTransformedPoints();
+    point_num += clouds[i]->size();
+  }
+
+  // the k-th neighbor distances and the correspondences of both backends, to check they agree
+  SearchBackend<PCLPoint>::Type types[2] = {SearchBackend<PCLPoint>::KDTREE, SearchBackend<PCLPoint>::GRID};
+  std::vector<std::vector<float> > kth_distances[2];
+  std::vector<pcl::Correspondences> correspondences[2];
+  for (int t = 0; t < 2; ++ t)
+  {
+    QElapsedTimer timer;
+    timer.start();
+    std::vector<SearchBackend<PCLPoint>::Ptr> searches(view_number);
+    for (size_t i = 0; i < view_number; ++ i)
+      searches[i] = createSearch(clouds[i], types[t]);
+    qint64 build_elapsed = timer.restart();
+
+    kth_distances[t].resize(view_number);
+    for (size_t i = 0; i < view_number; ++ i)
+    {
+      size_t cloud_size = clouds[i]->size();
+      std::vector<std::pair<size_t, size_t> > blocks;
+      for (size_t j = 0; j < cloud_size; j += block_size)
+        blocks.push_back(std::make_pair(j, std::min(j+block_size, cloud_size)));
+      kth_distances[t][i].resize(cloud_size);
+      QtConcurrent::blockingMap(blocks, KthNeighborDistances(*searches[i], k, kth_distances[t][i]));
+    }
+    qint64 knn_elapsed = timer.restart();
+
+    correspondences[t].resize(view_number);
+    size_t correspondence_num = 0;
+    for (size_t i = 0; i < view_number; ++ i)
+    {
+      determineReciprocalCorrespondences(*searches[i], *searches[(i+1)%view_number], max_distance, correspondences[t][i]);
+      correspondence_num += correspondences[t][i].size();
+    }
+    qint64 correspondence_elapsed = timer.elapsed();
+
+    std::cout << "Search benchmark: frame " << frame << " " << searches[0]->getName() << " of " << point_num << " points"
+      << ", build " << build_elapsed << "ms"
+      << ", " << k << " nearest neighbors " << knn_elapsed << "ms"
+      << ", " << correspondence_num << " correspondences " << correspondence_elapsed << "ms"
+      << ", total " << build_elapsed+knn_elapsed+correspondence_elapsed << "ms" << std::endl;
+  }
+
+  size_t same_neighborhoods = 0, same_correspondences = 0, correspondence_num = 0;
+  for (size_t i = 0; i < view_number; ++ i)
+  {
+    for (size_t j = 0, j_end = kth_distances[0][i].size(); j < j_end; ++ j)
+      if (kth_distances[0][i][j] == kth_distances[1][i][j])
+        same_neighborhoods ++;
+
+    const pcl::Correspondences& kdtree_correspondences = correspondences[0][i];
+    const pcl::Correspondences& grid_correspondences = correspondences[1][i];
+    correspondence_num += std::max(kdtree_correspondences.size(), grid_correspondences.size());
+    for (size_t j = 0, p = 0, j_end = kdtree_correspondences.size(), p_end = grid_correspondences.size(); j < j_end && p < p_end; )
+    {
+      const pcl::Correspondence& a = kdtree_correspondences[j];
+      const pcl::Correspondence& b = grid_correspondences[p];
+      if (a.index_query < b.index_query)
+        ++ j;
+      else if (b.index_query < a.index_query)
+        ++ p;
+      else
+      {
+        if (a.index_match == b.index_match)
+          same_correspondences ++;
+        ++ j;
+        ++ p;
+      }
+    }
+  }
+  std::cout << "Search benchmark: frame " << frame << " backends agree on " << same_neighborhoods << " of " << point_num
+    << " neighborhoods and " << same_correspondences << " of " << correspondence_num << " correspondences" << std::endl;
+
+  return;
+}
+
+void Registrator::benchmarkSearch(void)
+{
+  int frame;
+  if (!ParameterManager::getInstance().getFrameParameter(frame))
+    return;
+
+  QFutureWatcher<void>* watcher = new QFutureWatcher<void>(this);
+  connect(watcher, SIGNAL(finished()), watcher, SLOT(deleteLater()));
+
+  QString running_message = QString("Search benchmark for frame %1 is running!").arg(frame);
+  QString finished_message = QString("Search benchmark for frame %1 finished!").arg(frame);
+  Messenger* messenger = new Messenger(running_message, finished_message, this);
+  connect(watcher, SIGNAL(started()), messenger, SLOT(sendRunningMessage()));
+  connect(watcher, SIGNAL(finished()), messenger, SLOT(sendFinishedMessage()));
+
+  watcher->setFuture(QtConcurrent::run(this, &Registrator::benchmarkSearch, frame));
+
+  return;
+}
+
 void Registrator::registration(void)
 {
   int frame, segment_threshold;
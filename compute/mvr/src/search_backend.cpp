@@ -0,0 +1,462 @@
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <QtConcurrentMap>
+
+#include "overlap_filter.h"
+#include "search_backend.h"
+
+// bits of a cell coordinate in its key
+static const int key_bits = 21;
+static const double key_max = double((1 << key_bits)-1);
+
+// the grid aims at this many points per occupied cell, a few more than the queries need from the 27 around
+static const double points_per_cell = 6.0;
+
+// query points per task of the correspondences
+static const size_t block_size = 4096;
+
+template <class PointT>
+static inline bool isFinite(const PointT& point)
+{
+  return pcl_isfinite(point.x) && pcl_isfinite(point.y) && pcl_isfinite(point.z);
+}
+
+template <class PointT>
+typename SearchBackend<PointT>::Ptr SearchBackend<PointT>::create(Type type)
+{
+  if (type == GRID)
+    return Ptr(new GridSearch<PointT>());
+
+  return Ptr(new KdTreeSearch<PointT>());
+}
+
+template <class PointT>
+void SearchBackend<PointT>::setInputCloud(const CloudConstPtr& cloud)
+{
+  cloud_ = cloud;
+  build();
+
+  return;
+}
+
+template <class PointT>
+void KdTreeSearch<PointT>::build(void)
+{
+  kdtree_.setInputCloud(this->cloud_);
+
+  return;
+}
+
+template <class PointT>
+int KdTreeSearch<PointT>::nearestKSearch(const PointT& point, int k,
+  std::vector<int>& indices, std::vector<float>& squared_distances) const
+{
+  return kdtree_.nearestKSearch(point, k, indices, squared_distances);
+}
+
+template <class PointT>
+int KdTreeSearch<PointT>::radiusSearch(const PointT& point, double radius,
+  std::vector<int>& indices, std::vector<float>& squared_distances) const
+{
+  return kdtree_.radiusSearch(point, radius, indices, squared_distances);
+}
+
+template <class PointT>
+GridSearch<PointT>::GridSearch(double cell_size)
+  :requested_cell_size_(cell_size),
+  cell_size_(0.0)
+{
+  for (int i = 0; i < 3; ++ i)
+  {
+    min_[i] = 0.0f;
+    dimensions_[i] = 0;
+  }
+}
+
+static inline uint64_t getKey(int64_t x, int64_t y, int64_t z)
+{
+  return (uint64_t(x) << (2*key_bits)) | (uint64_t(y) << key_bits) | uint64_t(z);
+}
+
+template <class PointT>
+void GridSearch<PointT>::getCell(const PointT& point, int64_t* cell) const
+{
+  cell[0] = (int64_t)(std::floor((point.x-min_[0])/cell_size_));
+  cell[1] = (int64_t)(std::floor((point.y-min_[1])/cell_size_));
+  cell[2] = (int64_t)(std::floor((point.z-min_[2])/cell_size_));
+
+  return;
+}
+
+template <class PointT>
+const typename GridSearch<PointT>::Cell* GridSearch<PointT>::findCell(int64_t x, int64_t y, int64_t z) const
+{
+  typename CellMap::const_iterator it = cells_.find(getKey(x, y, z));
+
+  return (it == cells_.end())?(NULL):(&(it->second));
+}
+
+template <class PointT>
+void GridSearch<PointT>::build(void)
+{
+  const pcl::PointCloud<PointT>& cloud = *(this->cloud_);
+
+  float max[3];
+  for (int i = 0; i < 3; ++ i)
+  {
+    min_[i] = std::numeric_limits<float>::max();
+    max[i] = -std::numeric_limits<float>::max();
+  }
+  size_t finite_num = 0;
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    const PointT& point = cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    finite_num ++;
+    const float position[3] = {point.x, point.y, point.z};
+    for (int j = 0; j < 3; ++ j)
+    {
+      min_[j] = std::min(min_[j], position[j]);
+      max[j] = std::max(max[j], position[j]);
+    }
+  }
+  if (finite_num == 0)
+  {
+    for (int i = 0; i < 3; ++ i)
+      min_[i] = max[i] = 0.0f;
+  }
+
+  if (requested_cell_size_ > 0)
+  {
+    build(requested_cell_size_);
+    return;
+  }
+
+  // a first guess from the bounding box, as if the points covered its faces, then one
+  // correction from the occupancy it gave, the points of a surface go with 1/cell_size^2
+  double dx = max[0]-min_[0], dy = max[1]-min_[1], dz = max[2]-min_[2];
+  double area = dx*dy+dy*dz+dz*dx;
+  double cell_size = std::sqrt(area*points_per_cell/std::max(finite_num, size_t(1)));
+  build(cell_size);
+
+  double occupancy = cells_.empty()?(points_per_cell):(double(finite_num)/cells_.size());
+  if (occupancy < points_per_cell/2 || occupancy > points_per_cell*2)
+    build(cell_size_*std::sqrt(points_per_cell/occupancy));
+
+  return;
+}
+
+template <class PointT>
+void GridSearch<PointT>::build(double cell_size)
+{
+  const pcl::PointCloud<PointT>& cloud = *(this->cloud_);
+
+  double extent = 0.0;
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    const PointT& point = cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    extent = std::max(extent, double(point.x-min_[0]));
+    extent = std::max(extent, double(point.y-min_[1]));
+    extent = std::max(extent, double(point.z-min_[2]));
+  }
+  cell_size_ = std::max(cell_size, extent/(key_max-1));
+  if (!(cell_size_ > 0))
+    cell_size_ = 1.0;
+  for (int i = 0; i < 3; ++ i)
+    dimensions_[i] = (int64_t)(extent/cell_size_)+1;
+
+  std::vector<std::pair<uint64_t, int> > keyed_indices;
+  keyed_indices.reserve(cloud.size());
+  for (size_t i = 0, i_end = cloud.size(); i < i_end; ++ i)
+  {
+    const PointT& point = cloud.points[i];
+    if (!isFinite(point))
+      continue;
+    int64_t cell[3];
+    getCell(point, cell);
+    keyed_indices.push_back(std::make_pair(getKey(cell[0], cell[1], cell[2]), int(i)));
+  }
+  std::sort(keyed_indices.begin(), keyed_indices.end());
+
+  size_t point_num = keyed_indices.size();
+  indices_.resize(point_num);
+  positions_.resize(3*point_num);
+  CellMap().swap(cells_);
+  Cell* cell = NULL;
+  for (size_t i = 0; i < point_num; ++ i)
+  {
+    const PointT& point = cloud.points[keyed_indices[i].second];
+    indices_[i] = keyed_indices[i].second;
+    positions_[3*i] = point.x;
+    positions_[3*i+1] = point.y;
+    positions_[3*i+2] = point.z;
+
+    if (i == 0 || keyed_indices[i].first != keyed_indices[i-1].first)
+    {
+      cell = &cells_[keyed_indices[i].first];
+      cell->begin = (uint32_t)(i);
+    }
+    cell->end = (uint32_t)(i+1);
+  }
+
+  return;
+}
+
+typedef std::pair<float, int> Neighbor;
+
+template <class PointT>
+int GridSearch<PointT>::nearestKSearch(const PointT& point, int k,
+  std::vector<int>& indices, std::vector<float>& squared_distances) const
+{
+  indices.clear();
+  squared_distances.clear();
+  if (k <= 0 || indices_.empty() || !isFinite(point))
+    return 0;
+
+  int64_t center[3];
+  getCell(point, center);
+  int64_t max_ring = 0;
+  for (int i = 0; i < 3; ++ i)
+    max_ring = std::max(max_ring, std::max(std::abs(center[i]), std::abs(dimensions_[i]-1-center[i])));
+
+  // the k closest so far, the farthest of them on top
+  std::vector<Neighbor> heap;
+  heap.reserve(k+1);
+
+  for (int64_t ring = 0; ring <= max_ring; ++ ring)
+  {
+    int64_t x_begin = std::max(center[0]-ring, int64_t(0)), x_end = std::min(center[0]+ring, dimensions_[0]-1);
+    int64_t y_begin = std::max(center[1]-ring, int64_t(0)), y_end = std::min(center[1]+ring, dimensions_[1]-1);
+    for (int64_t x = x_begin; x <= x_end; ++ x)
+    {
+      for (int64_t y = y_begin; y <= y_end; ++ y)
+      {
+        // inside the shell only its two z faces are new
+        bool on_shell = (std::abs(x-center[0]) == ring || std::abs(y-center[1]) == ring);
+        int64_t z_step = (on_shell || ring == 0)?(1):(2*ring);
+        for (int64_t z = center[2]-ring; z <= center[2]+ring; z += z_step)
+        {
+          if (z < 0 || z >= dimensions_[2])
+            continue;
+          const Cell* cell = findCell(x, y, z);
+          if (cell == NULL)
+            continue;
+
+          for (uint32_t i = cell->begin; i < cell->end; ++ i)
+          {
+            const float* position = &positions_[3*i];
+            float dx = position[0]-point.x, dy = position[1]-point.y, dz = position[2]-point.z;
+            float squared_distance = dx*dx+dy*dy+dz*dz;
+            if ((int)(heap.size()) < k)
+            {
+              heap.push_back(Neighbor(squared_distance, indices_[i]));
+              std::push_heap(heap.begin(), heap.end());
+            }
+            else if (Neighbor(squared_distance, indices_[i]) < heap.front())
+            {
+              std::pop_heap(heap.begin(), heap.end());
+              heap.back() = Neighbor(squared_distance, indices_[i]);
+              std::push_heap(heap.begin(), heap.end());
+            }
+          }
+        }
+      }
+    }
+
+    // the cells of the next rings are at least ring*cell_size_ away
+    double reach = ring*cell_size_;
+    if ((int)(heap.size()) == k && heap.front().first <= reach*reach)
+      break;
+  }
+
+  std::sort_heap(heap.begin(), heap.end());
+  indices.resize(heap.size());
+  squared_distances.resize(heap.size());
+  for (size_t i = 0, i_end = heap.size(); i < i_end; ++ i)
+  {
+    squared_distances[i] = heap[i].first;
+    indices[i] = heap[i].second;
+  }
+
+  return (int)(heap.size());
+}
+
+template <class PointT>
+int GridSearch<PointT>::radiusSearch(const PointT& point, double radius,
+  std::vector<int>& indices, std::vector<float>& squared_distances) const
+{
+  indices.clear();
+  squared_distances.clear();
+  if (!(radius > 0) || indices_.empty() || !isFinite(point))
+    return 0;
+
+  int64_t center[3];
+  getCell(point, center);
+  int64_t ring = (int64_t)(std::ceil(radius/cell_size_));
+  float squared_radius = (float)(radius*radius);
+
+  int64_t begin[3], end[3];
+  for (int i = 0; i < 3; ++ i)
+  {
+    begin[i] = std::max(center[i]-ring, int64_t(0));
+    end[i] = std::min(center[i]+ring, dimensions_[i]-1);
+  }
+
+  std::vector<Neighbor> neighbors;
+  for (int64_t x = begin[0]; x <= end[0]; ++ x)
+  {
+    for (int64_t y = begin[1]; y <= end[1]; ++ y)
+    {
+      for (int64_t z = begin[2]; z <= end[2]; ++ z)
+      {
+        const Cell* cell = findCell(x, y, z);
+        if (cell == NULL)
+          continue;
+
+        for (uint32_t i = cell->begin; i < cell->end; ++ i)
+        {
+          const float* position = &positions_[3*i];
+          float dx = position[0]-point.x, dy = position[1]-point.y, dz = position[2]-point.z;
+          float squared_distance = dx*dx+dy*dy+dz*dz;
+          if (squared_distance <= squared_radius)
+            neighbors.push_back(Neighbor(squared_distance, indices_[i]));
+        }
+      }
+    }
+  }
+
+  std::sort(neighbors.begin(), neighbors.end());
+  indices.resize(neighbors.size());
+  squared_distances.resize(neighbors.size());
+  for (size_t i = 0, i_end = neighbors.size(); i < i_end; ++ i)
+  {
+    squared_distances[i] = neighbors[i].first;
+    indices[i] = neighbors[i].second;
+  }
+
+  return (int)(neighbors.size());
+}
+
+template class SearchBackend<PCLPoint>;
+template class SearchBackend<PCLRichPoint>;
+template class KdTreeSearch<PCLPoint>;
+template class KdTreeSearch<PCLRichPoint>;
+template class GridSearch<PCLPoint>;
+template class GridSearch<PCLRichPoint>;
+
+// a block of source points and the correspondences found for them, concatenated in block order
+struct CorrespondenceBlock
+{
+  size_t                begin;
+  size_t                end;
+  pcl::Correspondences  correspondences;
+};
+
+class ReciprocalCorrespondences
+{
+public:
+  typedef void result_type;
+
+  ReciprocalCorrespondences(const SearchBackend<PCLPoint>& source_search, const SearchBackend<PCLPoint>& target_search,
+    const Eigen::Affine3f& source_to_target, const OverlapFilter* target_overlap, double max_distance)
+    :source_search_(source_search), target_search_(target_search), target_overlap_(target_overlap),
+    source_to_target_(source_to_target), target_to_source_(source_to_target.inverse(Eigen::Isometry)),
+    transformed_(!source_to_target.matrix().isIdentity()), max_squared_distance_(max_distance*max_distance)
+  {}
+
+  void operator()(CorrespondenceBlock& block) const
+  {
+    const PCLPointCloud& source = *(source_search_.getInputCloud());
+    const PCLPointCloud& target = *(target_search_.getInputCloud());
+
+    std::vector<int> index(1), index_reciprocal(1);
+    std::vector<float> distance(1), distance_reciprocal(1);
+    for (size_t i = block.begin; i < block.end; ++ i)
+    {
+      if (!isFinite(source.points[i]))
+        continue;
+      // most of the source is out of the target's reach and skips the queries
+      PCLPoint query = transform(source.points[i], source_to_target_);
+      if (target_overlap_ != NULL && !target_overlap_->contains(query))
+        continue;
+      if (target_search_.nearestKSearch(query, 1, index, distance) == 0 || distance[0] > max_squared_distance_)
+        continue;
+
+      int target_index = index[0];
+      if (source_search_.nearestKSearch(transform(target.points[target_index], target_to_source_), 1, index_reciprocal, distance_reciprocal) == 0
+        || distance_reciprocal[0] > max_squared_distance_ || index_reciprocal[0] != int(i))
+        continue;
+
+      pcl::Correspondence correspondence;
+      correspondence.index_query = int(i);
+      correspondence.index_match = target_index;
+      correspondence.distance = distance[0];
+      block.correspondences.push_back(correspondence);
+    }
+
+    return;
+  }
+
+private:
+  // unaligned, as the functor is copied to the heap by QtConcurrent
+  typedef Eigen::Transform<float, 3, Eigen::Affine, Eigen::DontAlign> Transformation;
+
+  inline PCLPoint transform(const PCLPoint& point, const Transformation& transformation) const
+  {
+    if (!transformed_)
+      return point;
+
+    PCLPoint transformed_point;
+    transformed_point.getVector3fMap() = transformation*point.getVector3fMap();
+
+    return transformed_point;
+  }
+
+  const SearchBackend<PCLPoint>&  source_search_;
+  const SearchBackend<PCLPoint>&  target_search_;
+  const OverlapFilter*            target_overlap_;
+  Transformation                  source_to_target_;
+  Transformation                  target_to_source_;
+  bool                            transformed_;
+  double                          max_squared_distance_;
+};
+
+void determineReciprocalCorrespondences(const SearchBackend<PCLPoint>& source_search,
+  const SearchBackend<PCLPoint>& target_search, double max_distance, pcl::Correspondences& correspondences,
+  const OverlapFilter* target_overlap)
+{
+  determineReciprocalCorrespondences(source_search, target_search, Eigen::Affine3f::Identity(),
+    max_distance, correspondences, target_overlap);
+
+  return;
+}
+
+void determineReciprocalCorrespondences(const SearchBackend<PCLPoint>& source_search,
+  const SearchBackend<PCLPoint>& target_search, const Eigen::Affine3f& source_to_target,
+  double max_distance, pcl::Correspondences& correspondences, const OverlapFilter* target_overlap)
+{
+  correspondences.clear();
+
+  // a filter for a shorter distance would drop correspondences
+  if (target_overlap != NULL && target_overlap->getDistance() < max_distance)
+    target_overlap = NULL;
+
+  size_t point_num = source_search.getInputCloud()->size();
+  std::vector<CorrespondenceBlock> blocks((point_num+block_size-1)/block_size);
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+  {
+    blocks[i].begin = i*block_size;
+    blocks[i].end = std::min(blocks[i].begin+block_size, point_num);
+  }
+  QtConcurrent::blockingMap(blocks, ReciprocalCorrespondences(source_search, target_search, source_to_target, target_overlap, max_distance));
+
+  for (size_t i = 0, i_end = blocks.size(); i < i_end; ++ i)
+    correspondences.insert(correspondences.end(), blocks[i].correspondences.begin(), blocks[i].correspondences.end());
+
+  return;
+}
@@ -1,5 +1,5 @@
-﻿#include <fstream>
-#include <QProcess>
+﻿#include <cmath>
+#include <fstream>
 #include <QMessageBox>
 #include <QMutexLocker>
 #include <QProgressBar>
@@ -7,10 +7,24 @@
 #include <QtConcurrentFilter>
 #include <QFileDialog>
 #include <QComboBox>
+#include <QThreadStorage>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QThread>
+#include <QThreadPool>
+#include <QtConcurrentMap>
+
+#include "decoder.h"
 
 #include "main_window.h"
 #include "point_cloud.h"
+#include "point_cloud_data.h"
+#include "downsampler.h"
+#include "grid_normal_estimator.h"
 #include "registrator.h"
+#include "crop_engine.h"
+#include "sphere_ball.h"
 #include "parameter_manager.h"
 #include "file_system_model.h"
 #include "osg_viewer_widget.h"
@@ -58,153 +72,472 @@ bool Task::run(void) const
 }
 
 
-TaskPointsGeneration::TaskPointsGeneration(int frame, int view, int ctr_threshold, int sat_threshold)
-  :TaskImpl(frame, view),ctr_threshold_(ctr_threshold), sat_threshold_(sat_threshold)
+TaskPointsGeneration::TaskPointsGeneration(int frame, int view, int ctr_threshold, int sat_threshold,
+  bool bilinear_color, bool fused_generation, bool keep_decode_maps, int normal_radius)
+  :TaskImpl(frame, view),ctr_threshold_(ctr_threshold), sat_threshold_(sat_threshold),
+  bilinear_color_(bilinear_color), fused_generation_(fused_generation), keep_decode_maps_(keep_decode_maps),
+  normal_radius_(normal_radius)
 {}
 
 TaskPointsGeneration::~TaskPointsGeneration(void)
 {}
 
-void TaskPointsGeneration::run(void) const
+// one decoder per worker thread, so its initialisation is paid once per thread instead of once per view
+static QThreadStorage<Decoder*> thread_decoder;
+
+Decoder& TaskPointsGeneration::getDecoder(void)
 {
-  convertImages();
+  if (!thread_decoder.hasLocalData())
+  {
+    // the views are already decoded on all the threads of the pool, so every decoder
+    // only gets its share of the cores instead of a thread per core
+    Decoder* decoder = new Decoder;
+    decoder->setThreadNumber(std::max(1, QThread::idealThreadCount()/QThreadPool::globalInstance()->maxThreadCount()));
+    thread_decoder.setLocalData(decoder);
+  }
 
+  return *thread_decoder.localData();
+}
+
+void TaskPointsGeneration::run(void) const
+{
   FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
+  std::string points_folder = model->getPointsFolder(frame_, view_);
+
+  // there is no default rig, a view is not decoded with the calibration of another workspace or a made up one
+  Decoder& decoder = getDecoder();
+  std::string workspace = MainWindow::getInstance()->getWorkspaceSafe();
+  if (!decoder.loadCalibration(workspace+"/calibration.txt"))
+  {
+    decoder.setCalibration(Calibration());
+    std::cout << "Points Generation: frame " << frame_ << " view " << view_ << " WARNING: cannot read "
+      << workspace << "/calibration.txt, the native decoder needs the calibration of the scanner" << std::endl;
+  }
+  decoder.setCacheFolder(workspace);
+  decoder.setScratchFolder(points_folder);
+
+  // the decode maps only depend on the images, so a threshold change neither loads nor decodes them again
+  QStringList filenames = getImageFilenames();
+  std::string signature = getImagesSignature(filenames);
+  std::string maps_filename = points_folder+"/decode_maps.bin";
+
+  DecodeMaps maps;
+  DecodedPoints points;
+  bool success = false;
+  if (!decoder.canDecode())
+    success = false;
+  else if (maps.load(maps_filename) && maps.signature == signature)
+  {
+    success = decoder.triangulate(maps, ctr_threshold_, sat_threshold_, points);
+    std::cout << "Points Generation: frame " << frame_ << " view " << view_ << " reused the decode maps" << std::endl;
+  }
+  else
+  {
+    std::vector<StripeImage> images;
+    size_t transcode_bytes = loadImages(filenames, images);
 
-  QStringList arguments;
-  arguments << model->getPointsFolder(frame_, view_).c_str()
-    << QString::number(ctr_threshold_) << QString::number(sat_threshold_);
-  QProcess process;
-  process.start(getExeFilename(), arguments);
-  process.waitForFinished(-1);
+    if (!images.empty() && decoder.computeMaps(images, maps))
+    {
+      maps.signature = signature;
+      if (keep_decode_maps_)
+        maps.save(maps_filename);
+      success = decoder.triangulate(maps, ctr_threshold_, sat_threshold_, points);
+    }
+    else if (!images.empty())
+      success = decoder.decode(images, ctr_threshold_, sat_threshold_, points);
 
-  deleteImages();
-  colorizePoints();
+    size_t saved_bytes = transcode_bytes-std::min(transcode_bytes, decoder.getScratchBytes());
+    std::cout << "Points Generation: frame " << frame_ << " view " << view_ << " "
+      << saved_bytes/1024 << "KB of bitmaps not written and deleted" << std::endl;
+  }
+
+  // the fused mode colorizes and saves the decoded points right away, without the bxyzuv round trip,
+  // otherwise they are stored as floats, like the cloud
+  if (!success)
+  {
+    // the outputs of an earlier generation would be taken for those of this one
+    std::string points_filename = points_folder+"/points.pcd";
+    QFile::remove(points_filename.c_str());
+    QFile::remove(PointCloudData::getGridFilename(points_filename).c_str());
+    QFile::remove((points_folder+"/points.bxyzuv").c_str());
+    std::cout << "Points Generation: frame " << frame_ << " view " << view_ << " failed to decode "
+      << filenames.size() << " images, the previous points were removed" << std::endl;
+  }
+  else if (fused_generation_)
+    colorizePoints(points);
+  else
+  {
+    Decoder::savePoints(points_folder+"/points.bxyzuv", points, true);
+    colorizePoints();
+  }
+
+  // the maps of an earlier generation are used once more and then dropped too
+  if (!keep_decode_maps_)
+    QFile::remove(maps_filename.c_str());
 
   model->updatePointCloud(frame_, view_);
 
   return;
 }
 
-void TaskPointsGeneration::convertImages(void) const
+QStringList TaskPointsGeneration::getImageFilenames(void) const
 {
   FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
 
+  QStringList filenames;
   for (size_t i = 0; i < 30; ++ i)
   {
-    QString load_filename = QString("%1/image_%2.jpg")
+    QString filename = QString("%1/image_%2.jpg")
       .arg(model->getImagesFolder(frame_, view_).c_str()).arg(i, 2, 10, QChar('0'));
 
-    if (!QFile::exists(load_filename))
+    if (QFile::exists(filename))
+      filenames.push_back(filename);
+  }
+
+  return filenames;
+}
+
+// the stripe set and the name, size and modification time of every image
+std::string TaskPointsGeneration::getImagesSignature(const QStringList& filenames) const
+{
+  QString signature(getDecoder().getCalibration().stripe_set.c_str());
+  for (int i = 0, i_end = filenames.size(); i < i_end; ++ i)
+  {
+    QFileInfo file_info(filenames[i]);
+    signature += QString(";%1:%2:%3").arg(file_info.fileName()).arg(file_info.size())
+      .arg(file_info.lastModified().toMSecsSinceEpoch());
+  }
+
+  return signature.toStdString();
+}
+
+struct LoadedStripeImage
+{
+  LoadedStripeImage(void):valid(false),elapsed(0),transcode_bytes(0){}
+
+  StripeImage   image;
+  bool          valid;
+  int           elapsed;
+  size_t        transcode_bytes;
+};
+
+static LoadedStripeImage loadStripeImage(const QString& filename)
+{
+  LoadedStripeImage loaded;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  QImage image;
+  if (!image.load(filename))
+    return loaded;
+
+  // the bitmap QImage::save used to write for the converter
+  int bits = (image.depth() == 32)?(24):(image.depth());
+  loaded.transcode_bytes = 14+40+image.colorCount()*4+((image.width()*bits+31)/32)*4*image.height();
+
+  StripeImage& stripe = loaded.image;
+  stripe = StripeImage(image.width(), image.height());
+  bool is_indexed = (image.format() == QImage::Format_Indexed8);
+  if (!is_indexed && image.format() != QImage::Format_RGB32 && image.format() != QImage::Format_ARGB32)
+    image = image.convertToFormat(QImage::Format_RGB32);
+
+  unsigned char gray_table[256] = {0};
+  for (int i = 0, i_end = std::min(image.colorCount(), 256); i < i_end; ++ i)
+    gray_table[i] = qGray(image.color(i));
+
+  for (int y = 0; y < stripe.height; ++ y)
+  {
+    unsigned char* row = &stripe.pixels[size_t(y)*stripe.width];
+    if (is_indexed)
+    {
+      const uchar* line = image.constScanLine(y);
+      for (int x = 0; x < stripe.width; ++ x)
+        row[x] = gray_table[line[x]];
+    }
+    else
+    {
+      const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+      for (int x = 0; x < stripe.width; ++ x)
+        row[x] = qGray(line[x]);
+    }
+  }
+
+  loaded.valid = true;
+  loaded.elapsed = timer.elapsed();
+
+  return loaded;
+}
+
+size_t TaskPointsGeneration::loadImages(const QStringList& filenames, std::vector<StripeImage>& images) const
+{
+  QElapsedTimer timer;
+  timer.start();
+
+  // jpeg decoding is the expensive part, so the images of a view are decoded in parallel
+  std::vector<LoadedStripeImage> loaded_images =
+    QtConcurrent::blockingMapped<std::vector<LoadedStripeImage> >(filenames, loadStripeImage);
+
+  int elapsed = timer.elapsed();
+
+  images.clear();
+  int serial_elapsed = 0;
+  size_t transcode_bytes = 0;
+  for (size_t i = 0, i_end = loaded_images.size(); i < i_end; ++ i)
+  {
+    if (!loaded_images[i].valid)
       continue;
 
-    QImage image;
-    bool f = image.load(load_filename);
+    images.push_back(StripeImage());
+    images.back().width = loaded_images[i].image.width;
+    images.back().height = loaded_images[i].image.height;
+    images.back().pixels.swap(loaded_images[i].image.pixels);
 
-    QString save_filename = QString("%1/%2.bmp").arg(model->getPointsFolder(frame_, view_).c_str()).arg(i);
-    bool flag = image.save(save_filename);
+    serial_elapsed += loaded_images[i].elapsed;
+    transcode_bytes += loaded_images[i].transcode_bytes;
   }
 
-  return;
+  std::cout << "Points Generation: frame " << frame_ << " view " << view_ << " loaded " << images.size()
+    << " stripe images in " << elapsed << "ms, " << std::max(serial_elapsed-elapsed, 0)
+    << "ms saved by decoding in parallel" << std::endl;
+
+  return transcode_bytes;
 }
 
-void TaskPointsGeneration::deleteImages(void) const
+// bxyzuv records mapped from a file
+template <class Real>
+class MappedRecords
 {
-  FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
+public:
+  MappedRecords(const char* data):records_((const Real*)(data)){}
 
-  for (size_t i = 0; i < 30; ++ i)
+  inline double x(size_t i) const {return records_[5*i];}
+  inline double y(size_t i) const {return records_[5*i+1];}
+  inline double z(size_t i) const {return records_[5*i+2];}
+  inline double u(size_t i) const {return records_[5*i+3];}
+  inline double v(size_t i) const {return records_[5*i+4];}
+
+private:
+  const Real* records_;
+};
+
+// points straight from the decoder
+class DecodedRecords
+{
+public:
+  DecodedRecords(const DecodedPoints& points):points_(points){}
+
+  inline double x(size_t i) const {return points_.x[i];}
+  inline double y(size_t i) const {return points_.y[i];}
+  inline double z(size_t i) const {return points_.z[i];}
+  inline double u(size_t i) const {return points_.u[i];}
+  inline double v(size_t i) const {return points_.v[i];}
+
+private:
+  const DecodedPoints& points_;
+};
+
+// converts blocks of records into a preallocated cloud, the normals point to the camera
+// until GridNormalEstimator replaces them
+template <class Records>
+class PointsColorizer
+{
+public:
+  typedef void result_type;
+
+  PointsColorizer(const Records& records, const QImage& snapshot, bool bilinear_color, PCLRichPointCloud& point_cloud)
+    :records_(records), snapshot_(snapshot), bilinear_color_(bilinear_color), point_cloud_(point_cloud)
+  {}
+
+  void operator()(const std::pair<size_t, size_t>& block) const
   {
-    QString delete_filename = QString("%1/%2.bmp").arg(model->getPointsFolder(frame_, view_).c_str()).arg(i);
-    QFile::remove(delete_filename);
+    for (size_t i = block.first; i < block.second; ++ i)
+    {
+      PCLRichPoint& point = point_cloud_.points[i];
+      point.x = (float)records_.x(i);
+      point.y = (float)records_.y(i);
+      point.z = (float)records_.z(i);
+
+      float length = std::sqrt(point.x*point.x+point.y*point.y+point.z*point.z);
+      float scale = (length > 0)?(-1.0f/length):(0.0f);
+      point.normal_x = point.x*scale;
+      point.normal_y = point.y*scale;
+      point.normal_z = point.z*scale;
+
+      double u = records_.u(i), v = records_.v(i);
+      QRgb rgb = bilinear_color_?(sampleBilinear(u, v)):(sampleNearest(u, v));
+      point.r = qRed(rgb);
+      point.g = qGreen(rgb);
+      point.b = qBlue(rgb);
+    }
+
+    return;
+  }
+
+private:
+  QRgb sampleNearest(double u, double v) const
+  {
+    int px = std::min(std::max((int)(u), 0), snapshot_.width()-1);
+    int py = std::min(std::max((int)(v), 0), snapshot_.height()-1);
+
+    return ((const QRgb*)(snapshot_.constScanLine(py)))[px];
   }
 
+  QRgb sampleBilinear(double u, double v) const
+  {
+    int width = snapshot_.width(), height = snapshot_.height();
+    u = std::min(std::max(u, 0.0), width-1.0);
+    v = std::min(std::max(v, 0.0), height-1.0);
+    int x0 = (int)(u), y0 = (int)(v);
+    int x1 = std::min(x0+1, width-1), y1 = std::min(y0+1, height-1);
+    double fx = u-x0, fy = v-y0;
+
+    const QRgb* line0 = (const QRgb*)(snapshot_.constScanLine(y0));
+    const QRgb* line1 = (const QRgb*)(snapshot_.constScanLine(y1));
+    QRgb c00 = line0[x0], c01 = line0[x1], c10 = line1[x0], c11 = line1[x1];
+    double w00 = (1-fx)*(1-fy), w01 = fx*(1-fy), w10 = (1-fx)*fy, w11 = fx*fy;
+
+    int r = (int)(w00*qRed(c00)+w01*qRed(c01)+w10*qRed(c10)+w11*qRed(c11)+0.5);
+    int g = (int)(w00*qGreen(c00)+w01*qGreen(c01)+w10*qGreen(c10)+w11*qGreen(c11)+0.5);
+    int b = (int)(w00*qBlue(c00)+w01*qBlue(c01)+w10*qBlue(c10)+w11*qBlue(c11)+0.5);
+
+    return qRgb(r, g, b);
+  }
+
+  Records             records_;
+  const QImage&       snapshot_;
+  bool                bilinear_color_;
+  PCLRichPointCloud&  point_cloud_;
+};
+
+template <class Records>
+static void colorizeRecords(const Records& records, size_t num_points, const QImage& snapshot, bool bilinear_color,
+  PCLRichPointCloud& point_cloud)
+{
+  point_cloud.resize(num_points);
+
+  size_t block_size = 1<<16;
+  std::vector<std::pair<size_t, size_t> > blocks;
+  for (size_t begin = 0; begin < num_points; begin += block_size)
+    blocks.push_back(std::make_pair(begin, std::min(begin+block_size, num_points)));
+  QtConcurrent::blockingMap(blocks, PointsColorizer<Records>(records, snapshot, bilinear_color, point_cloud));
+
+  return;
+}
+
+// the pixel of every point, on a grid covering the snapshot and all the points
+template <class Records>
+static void buildImageGrid(const Records& records, size_t num_points, const QImage& snapshot, ImageGrid& image_grid)
+{
+  int width = snapshot.width(), height = snapshot.height();
+  for (size_t i = 0; i < num_points; ++ i)
+  {
+    width = std::max(width, (int)(records.u(i)+0.5)+1);
+    height = std::max(height, (int)(records.v(i)+0.5)+1);
+  }
+
+  image_grid = ImageGrid(width, height, num_points);
+  for (size_t i = 0; i < num_points; ++ i)
+    image_grid.setPixel(i, (int)(records.u(i)+0.5), (int)(records.v(i)+0.5));
+
+  return;
+}
+
+static void savePointCloud(const std::string& points_folder, const PCLRichPointCloud& point_cloud, const ImageGrid& image_grid)
+{
+  PointCloudData::save(points_folder+"/points.pcd", point_cloud, &image_grid);
+
   return;
 }
 
+// constant 32 bit scanlines, so the blocks read the pixels directly
+static QImage loadSnapshot(const std::string& points_folder)
+{
+  QImage snapshot((points_folder+"/snapshot.jpg").c_str());
+  if (snapshot.isNull())
+    snapshot = QImage(1, 1, QImage::Format_RGB32);
+  if (snapshot.format() != QImage::Format_RGB32 && snapshot.format() != QImage::Format_ARGB32)
+    snapshot = snapshot.convertToFormat(QImage::Format_RGB32);
+
+  return snapshot;
+}
+
 void TaskPointsGeneration::colorizePoints(void) const
 {
   FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
   std::string points_folder = model->getPointsFolder(frame_, view_);
 
   std::string filename = points_folder+"/points.bxyzuv";
-  if (!QFile::exists(filename.c_str()))
+  QFile file(filename.c_str());
+  if (!file.open(QIODevice::ReadOnly))
     return;
 
-  QImage snapshot((points_folder+"/snapshot.jpg").c_str());
-
-  std::ifstream fin(filename, std::ios::binary);
-  if (!fin.good())
+  size_t file_size = file.size();
+  const char* data = (const char*)(file.map(0, file_size));
+  PointsHeader header;
+  if (data == NULL || !Decoder::parsePointsHeader(data, file_size, file_size, header))
     return;
 
-  long begin, end;
-  fin.seekg(0, std::ios::end);
-  end = fin.tellg();
-  fin.seekg(0, std::ios::beg);
-  begin = fin.tellg();
+  // the doubles after a version 1 header are not aligned, so they are read instead of mapped
+  if (!header.single_precision && header.size%sizeof(double) != 0)
+  {
+    file.unmap((uchar*)(data));
+    file.close();
+    DecodedPoints points;
+    bool loaded = Decoder::loadPoints(filename, points);
+    QFile::remove(filename.c_str());
+    if (loaded)
+      colorizePoints(points);
+    return;
+  }
 
-  PointCloud point_cloud;
-  long num_points = (end-begin)/(5*sizeof(double));
-  PCLRichPoint point;
-  while (num_points)
+  QImage snapshot = loadSnapshot(points_folder);
+  PCLRichPointCloud point_cloud;
+  ImageGrid image_grid;
+  if (header.single_precision)
   {
-    double x, y, z;
-    fin.read((char*)&x, sizeof(double));
-    fin.read((char*)&y, sizeof(double));
-    fin.read((char*)&z, sizeof(double));
-    point.x = x;
-    point.y = y;
-    point.z = z;
-
-    osg::Vec3 normal(-x, -y, -z);
-    normal.normalize();
-    point.normal_x = normal.x();
-    point.normal_y = normal.y();
-    point.normal_z = normal.z();
-
-    double u, v;
-    fin.read((char*)&u, sizeof(double));
-    fin.read((char*)&v, sizeof(double));
-
-    int px = std::min(std::max((int)(u), 0), snapshot.width()-1);
-    int py = std::min(std::max((int)(v), 0), snapshot.height()-1);
-    QColor rgb(snapshot.pixel(px, py));
-    point.r = rgb.red();
-    point.g = rgb.green();
-    point.b = rgb.blue();
-
-    point_cloud.push_back(point);
-    num_points --;
+    MappedRecords<float> records(data+header.size);
+    colorizeRecords(records, header.count, snapshot, bilinear_color_, point_cloud);
+    buildImageGrid(records, header.count, snapshot, image_grid);
+  }
+  else
+  {
+    MappedRecords<double> records(data+header.size);
+    colorizeRecords(records, header.count, snapshot, bilinear_color_, point_cloud);
+    buildImageGrid(records, header.count, snapshot, image_grid);
   }
 
-  fin.close();
-  if (!filename.empty())
-    QFile::remove(filename.c_str());
+  file.unmap((uchar*)(data));
+  file.close();
+  QFile::remove(filename.c_str());
 
-  point_cloud.save(points_folder+"/points.pcd");
+  if (normal_radius_ > 0)
+    GridNormalEstimator(image_grid, normal_radius_).compute(point_cloud);
+  savePointCloud(points_folder, point_cloud, image_grid);
 
   return;
 }
 
-
-QString TaskPointsGeneration::getExeFilename(void)
+void TaskPointsGeneration::colorizePoints(const DecodedPoints& points) const
 {
   FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
+  std::string points_folder = model->getPointsFolder(frame_, view_);
 
-  QString exe_filename;
-  QStringList root_entries = QDir(model->rootPath()).entryList();
-  for (QStringList::const_iterator root_entries_it = root_entries.begin();
-    root_entries_it != root_entries.end(); ++ root_entries_it)
-  {
-    if (root_entries_it->startsWith("TTReg-Convert") && root_entries_it->endsWith(".exe"))
-    {
-      exe_filename = model->rootPath()+"/"+*root_entries_it;
-      break;
-    }
-  }
+  QImage snapshot = loadSnapshot(points_folder);
+  PCLRichPointCloud point_cloud;
+  ImageGrid image_grid;
+  DecodedRecords records(points);
+  colorizeRecords(records, points.size(), snapshot, bilinear_color_, point_cloud);
+  buildImageGrid(records, points.size(), snapshot, image_grid);
 
-  return exe_filename;
+  if (normal_radius_ > 0)
+    GridNormalEstimator(image_grid, normal_radius_).compute(point_cloud);
+  savePointCloud(points_folder, point_cloud, image_grid);
+
+  return;
 }
 
+
 TaskDispatcher::TaskDispatcher(QObject* parent)
   :QObject(parent)
 {
@@ -338,21 +671,27 @@ void TaskDispatcher::dispatchTaskPointsGeneration(void)
   }
 
   int ctr_threshold, sat_threshold, start_frame, end_frame;
-  if (!ParameterManager::getInstance()
-    .getGenerationParameters(ctr_threshold, sat_threshold, start_frame, end_frame))
+  int normal_radius;
+  bool bilinear_color, fused_generation, keep_decode_maps;
+  if (!ParameterManager::getInstance().getGenerationParameters(ctr_threshold, sat_threshold, bilinear_color,
+    fused_generation, keep_decode_maps, normal_radius, start_frame, end_frame))
     return;
 
-  QString exe_filename = TaskPointsGeneration::getExeFilename();
-  if (!QFile::exists(exe_filename))
+  // the views would all fail, unless the decoder is GCSS3DLib with its built in calibration
+  std::string calibration_filename = MainWindow::getInstance()->getWorkspaceSafe()+"/calibration.txt";
+  Decoder decoder;
+  if (!decoder.loadCalibration(calibration_filename) && !decoder.canDecode())
   {
-    QMessageBox::warning(MainWindow::getInstance(), "Point Cloud Generator Warning",
-      "There's no EvoGeoConvert.exe in the root folder");
+    QMessageBox::warning(MainWindow::getInstance(), "Points Generation Task Warning",
+      QString("Cannot read the calibration of the scanner from %1, see calibration.h of TTReg-Convert")
+      .arg(calibration_filename.c_str()));
     return;
   }
 
   for (int frame = start_frame; frame <= end_frame; frame ++)
     for (int view = 0; view < view_number; ++ view)
-      points_generation_tasks_.push_back(Task(new TaskPointsGeneration(frame, view, ctr_threshold, sat_threshold)));
+      points_generation_tasks_.push_back(Task(new TaskPointsGeneration(frame, view, ctr_threshold, sat_threshold,
+        bilinear_color, fused_generation, keep_decode_maps, normal_radius)));
 
   runTasks(points_generation_tasks_, "Points Generation");
 
@@ -396,8 +735,9 @@ void TaskDispatcher::dispatchTaskRegistration(void)
   return;
 }
 
-TaskDenoise::TaskDenoise(int frame, int segment_threshold)
-	:TaskImpl(frame, -1), segment_threshold_(segment_threshold)
+TaskDenoise::TaskDenoise(int frame, int segment_threshold, double triangle_length, bool component_denoise)
+	:TaskImpl(frame, -1), segment_threshold_(segment_threshold), triangle_length_(triangle_length),
+	component_denoise_(component_denoise)
 {}
 
 TaskDenoise::~TaskDenoise(void)
@@ -407,11 +747,11 @@ void TaskDenoise::run(void) const
 {
 	FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
 	osg::ref_ptr<PointCloud> point_cloud = model->getPointCloud(frame_);
-	// Delaunay Triangulation Denoise Method
-	// point_cloud->denoise(segment_threshold_, ParameterManager::getInstance().getTriangleLength());
-
-	// Point Density Denoise Method
-    point_cloud->denoise(segment_threshold_);
+	// both methods only lock their own cloud, so the frames are denoised in parallel
+	if (component_denoise_)
+		point_cloud->denoise(segment_threshold_, triangle_length_);
+	else
+		point_cloud->denoise(segment_threshold_);
 	point_cloud->removeNoise();
 
 	return;
@@ -427,39 +767,20 @@ void TaskDispatcher::dispatchTaskDenoise(void)
 	}
 
 	int segment_threshold, start_frame, end_frame;
-	if (!ParameterManager::getInstance().getDenoiseParameters(segment_threshold, start_frame, end_frame))
+	double triangle_length;
+	bool component_denoise;
+	if (!ParameterManager::getInstance().getDenoiseParameters(segment_threshold, triangle_length, component_denoise,
+		start_frame, end_frame))
 		return;
 
 	for (int frame = start_frame; frame <= end_frame; frame ++)
-		denoise_tasks_.push_back(Task(new TaskDenoise(frame, segment_threshold)));
+		denoise_tasks_.push_back(Task(new TaskDenoise(frame, segment_threshold, triangle_length, component_denoise)));
 
 	runTasks(denoise_tasks_, "Denoise Frames");
 
 	return;
 }
 
-void TaskDispatcher::dispatchTaskDenoiseBySerialOrder()
-{
-	int segment_threshold, start_frame, end_frame;
-	if (!ParameterManager::getInstance().getDenoiseParameters(segment_threshold, start_frame, end_frame))
-		return;
-
-	for (int frame = start_frame; frame <= end_frame; frame ++)
-	{
-		FileSystemModel* model = MainWindow::getInstance()->getFileSystemModel();
-		PointCloud* point_cloud = model->getPointCloud(frame);
-		// Delaunay Triangulation Denoise Method
-		//point_cloud->denoise(segment_threshold, ParameterManager::getInstance().getTriangleLength());
-
-		// Point Density Denoise Method
-		point_cloud->denoise(segment_threshold);
-		point_cloud->removeNoise();
-	}
-	std::cout << "finished!" << std::endl;
-
-	return;
-}
-
 
 TaskExtractImages::TaskExtractImages(int frame, int view_number, std::string folder)
 	:TaskImpl(frame, -1), view_number_(view_number), folder_(folder)
@@ -597,9 +918,61 @@ void TaskDispatcher::dispatchTaskRemoveOutliers()
 	return;
 }
 
+TaskCrop::TaskCrop(int frame, bool by_plane, bool by_sphere)
+	:TaskImpl(frame, -1), by_plane_(by_plane), by_sphere_(by_sphere)
+{}
+
+TaskCrop::~TaskCrop(void)
+{}
+
+void TaskCrop::run(void) const
+{
+	MainWindow* main_window = MainWindow::getInstance();
+	osg::ref_ptr<PointCloud> point_cloud = main_window->getFileSystemModel()->getPointCloud(frame_);
+
+	CropEngine crop_engine;
+	if (by_plane_)
+	{
+		Registrator* registrator = main_window->getRegistrator();
+		crop_engine.addHalfSpace(osg::Plane(registrator->getAxisNormal(), registrator->getPivotPoint()).asVec4());
+	}
+	if (by_sphere_)
+	{
+		SphereBall* sphere_ball = main_window->getSphereBall();
+		crop_engine.addSphere(sphere_ball->getCenter(), sphere_ball->getRadius());
+	}
+
+	point_cloud->crop(crop_engine, "Crop");
+	point_cloud->removeNoise();
+
+	return;
+}
+
+void TaskDispatcher::dispatchTaskCrop()
+{
+	if (!crop_tasks_.isEmpty())
+	{
+		QMessageBox::warning(MainWindow::getInstance(), "Crop Task Warning",
+			"Run crop task after the previous one has finished");
+		return;
+	}
+
+	bool by_plane, by_sphere;
+	int start_frame, end_frame;
+	if (!ParameterManager::getInstance().getCropParameters(by_plane, by_sphere, start_frame, end_frame))
+		return;
 
-TaskDownsampling::TaskDownsampling(int frame, int sample_ratio, std::string folder)
-	:TaskImpl(frame, -1), folder_(folder), sample_ratio_(sample_ratio)
+	for (int frame = start_frame; frame <= end_frame; frame ++)
+		crop_tasks_.push_back(Task(new TaskCrop(frame, by_plane, by_sphere)));
+
+	runTasks(crop_tasks_, "Crop");
+
+	return;
+}
+
+
+TaskDownsampling::TaskDownsampling(int frame, int sample_ratio, int point_budget, bool poisson_disk, std::string folder)
+	:TaskImpl(frame, -1), sample_ratio_(sample_ratio), point_budget_(point_budget), poisson_disk_(poisson_disk), folder_(folder)
 {}
 
 TaskDownsampling::~TaskDownsampling(void)
@@ -615,22 +988,20 @@ void TaskDownsampling::run(void) const
 		std::cout<<"Frame:"<<frame_<<" where is the point cloud?"<<std::endl;
 		return;
 	}
+	if (!point_cloud->restoreExactPoints())
+		return;
 
 	std::cout << "Downsampling Frame:" << frame_ << std::endl;
 
-	std::vector<size_t> indices(point_cloud->size());
-	for (size_t i = 0, i_end = indices.size(); i < i_end; ++ i)
-		indices[i] = i;
-	std::random_shuffle(indices.begin(), indices.end());
+	size_t point_budget = (point_budget_ > 0)?(size_t(point_budget_)):(point_cloud->size()/sample_ratio_);
+	point_budget = std::max(point_budget, size_t(1));
 
-	PointCloud extract_cloud;  
-	size_t extract_point_size = indices.size()/sample_ratio_;
-	assert(extract_point_size != 0);
-	while(extract_point_size > 0)
-	{
-		extract_cloud.push_back(point_cloud->at(indices[extract_point_size - 1]));
-		extract_point_size --;
-	}
+	PointCloudData extract_cloud;
+	Downsampler downsampler(*point_cloud);
+	double scale = poisson_disk_?(downsampler.poissonDiskToBudget(point_budget, extract_cloud))
+		:(downsampler.voxelGridToBudget(point_budget, extract_cloud));
+	std::cout << "Downsampling: frame " << frame_ << " kept " << extract_cloud.size() << " of " << point_cloud->size()
+		<< " points with " << (poisson_disk_?("radius "):("voxel size ")) << scale << std::endl;
 
 	QString root_folder = QString("%1").arg(folder_.c_str());
 	QDir root_path(root_folder);
@@ -664,12 +1035,13 @@ void TaskDispatcher::dispatchTaskDownsampling(void)
 		return;
 	}
 
-	int start_frame, end_frame, sample_ratio;
-	if (!ParameterManager::getInstance().getDownsamplingParameters(sample_ratio, start_frame, end_frame))
+	int start_frame, end_frame, sample_ratio, point_budget;
+	bool poisson_disk;
+	if (!ParameterManager::getInstance().getDownsamplingParameters(sample_ratio, point_budget, poisson_disk, start_frame, end_frame))
 		return;
 
 	for (int frame = start_frame; frame <= end_frame; frame ++)
-		downsampling_tasks_.push_back(Task(new TaskDownsampling(frame, sample_ratio, save_directory.toStdString())));
+		downsampling_tasks_.push_back(Task(new TaskDownsampling(frame, sample_ratio, point_budget, poisson_disk, save_directory.toStdString())));
 
 	runTasks(downsampling_tasks_, "Downsampling");
 
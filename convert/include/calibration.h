@@ -0,0 +1,34 @@
+#pragma once
+#ifndef CALIBRATION_H_
+#define CALIBRATION_H_
+
+#include <string>
+
+// Camera and projector of the scanner, in millimeters and pixels.
+// A point X in camera space is X_p = rotation*X+translation in projector space.
+// The file is plain text, one keyword followed by its values per line, all of them are required:
+//   stripe_set 1024x768x30
+//   camera fx fy cx cy
+//   projector fx fy cx cy
+//   rotation r00 r01 r02 r10 r11 r12 r20 r21 r22
+//   translation tx ty tz
+struct Calibration
+{
+  // an empty calibration, which is not valid, there is no default rig to decode with
+  Calibration(void);
+
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  // a known stripe set and positive focal lengths
+  bool isValid(void) const;
+
+  std::string   stripe_set;
+  // a negative principal point means the image center
+  double        camera_fx, camera_fy, camera_cx, camera_cy;
+  double        projector_fx, projector_fy, projector_cx, projector_cy;
+  double        rotation[9];
+  double        translation[3];
+};
+
+#endif /*CALIBRATION_H_*/
@@ -0,0 +1,121 @@
+#pragma once
+#ifndef DECODER_H_
+#define DECODER_H_
+
+#include <string>
+#include <vector>
+#include <memory>
+
+#include "calibration.h"
+#include "stripe_decoder.h"
+
+// 8 bit gray stripe image, row major without padding
+struct StripeImage
+{
+  StripeImage(void):width(0),height(0){}
+  StripeImage(int w, int h):width(w),height(h),pixels(size_t(w)*h, 0){}
+
+  int                         width;
+  int                         height;
+  std::vector<unsigned char>  pixels;
+};
+
+// decoded points in camera space, together with their image coordinates
+struct DecodedPoints
+{
+  inline size_t size(void) const {return x.size();}
+  void clear(void);
+  void resize(size_t num_points);
+
+  std::vector<double>   x;
+  std::vector<double>   y;
+  std::vector<double>   z;
+  std::vector<double>   u;
+  std::vector<double>   v;
+};
+
+// Header of points.bxyzuv, followed by count records of x y z u v, as doubles or floats.
+// It takes a multiple of 8 bytes, so the records of a mapped file are aligned, except in version 1.
+// Files written by GCSS3DLib times have no header and always hold doubles.
+struct PointsHeader
+{
+  PointsHeader(void);
+
+  inline size_t getRecordSize(void) const {return 5*(single_precision?sizeof(float):sizeof(double));}
+
+  // bytes before the first record, 0 for headerless files
+  size_t              size;
+  unsigned int        version;
+  bool                single_precision;
+  unsigned long long  count;
+  double              min[3];
+  double              max[3];
+};
+
+// The structured-light decoder used by both TTReg-Convert and TTReg-Compute.
+// A Decoder is meant to be created once per worker thread and reused for
+// every view it converts. It decodes natively with StripeDecoder, unless
+// it is built with TTREG_WITH_GCSS3DLIB, where the closed GCSS3DLib is used.
+class Decoder
+{
+public:
+  Decoder(void);
+  ~Decoder(void);
+
+  // decode the stripe images 0.bmp, 1.bmp, ... in folder, or image_00.jpg, image_01.jpg, ... as captured
+  bool decode(const std::string& folder, int ctr_threshold, int sat_threshold, DecodedPoints& points);
+  // decode stripe images that are already in memory
+  bool decode(const std::vector<StripeImage>& images, int ctr_threshold, int sat_threshold, DecodedPoints& points);
+
+  // decoding split in the image dependent maps and the threshold dependent triangulation,
+  // false if the backend can only decode in one go
+  bool computeMaps(const std::vector<StripeImage>& images, DecodeMaps& maps);
+  bool triangulate(const DecodeMaps& maps, int ctr_threshold, int sat_threshold, DecodedPoints& points);
+
+  // the calibration also names the stripe set the images were captured with, the native decoder
+  // fails without a valid one, while GCSS3DLib has the calibration of the scanner built in
+  bool loadCalibration(const std::string& filename);
+  bool canDecode(void) const;
+  inline void setCalibration(const Calibration& calibration) {calibration_ = calibration;}
+  inline const Calibration& getCalibration(void) const {return calibration_;}
+
+  // threads of the native decoder, 0 uses one thread per core
+  inline void setThreadNumber(int thread_number) {stripe_decoder_.setThreadNumber(thread_number);}
+
+  // folder where the ray table of the calibration is kept between sessions, empty keeps it in memory only
+  inline void setCacheFolder(const std::string& folder) {cache_folder_ = folder;}
+
+  // folder used to hand in-memory images to a backend that can only read from disk
+  inline void setScratchFolder(const std::string& folder) {scratch_folder_ = folder;}
+  // bytes the last in-memory decode had to write to the scratch folder
+  inline size_t getScratchBytes(void) const {return scratch_bytes_;}
+
+  static size_t getBitmapSize(const StripeImage& image);
+  // 1 or 8 bit indexed and 24 or 32 bit color bitmaps, and jpeg images if built with libjpeg, converted to gray
+  static bool loadStripeImage(const std::string& filename, StripeImage& image);
+  static std::string getStripeImageFilename(const std::string& folder, int index);
+  static bool loadStripeImages(const std::string& folder, int image_number, std::vector<StripeImage>& images);
+  static bool saveStripeImage(const std::string& filename, const StripeImage& image);
+  // points are written in large chunks, as floats if single_precision is set
+  static bool savePoints(const std::string& filename, const DecodedPoints& points, bool single_precision=false);
+  static bool loadPoints(const std::string& filename, DecodedPoints& points);
+  // parse the header at the beginning of a points file of file_size bytes, only a file without
+  // the magic is taken for headerless doubles, a damaged or unknown header fails
+  static bool parsePointsHeader(const char* data, size_t data_size, size_t file_size, PointsHeader& header);
+
+private:
+  Decoder(const Decoder&);
+  Decoder& operator=(const Decoder&);
+
+  const StripeSet* getStripeSet(void) const;
+  // the ray table of the calibration, computed or loaded once and shared by all the decoders
+  std::shared_ptr<const RayTable> getRayTable(const StripeSet& stripe_set, int width, int height) const;
+
+  Calibration   calibration_;
+  StripeDecoder stripe_decoder_;
+  std::string   cache_folder_;
+  std::string   scratch_folder_;
+  size_t        scratch_bytes_;
+};
+
+#endif /*DECODER_H_*/
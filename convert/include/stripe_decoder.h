@@ -0,0 +1,95 @@
+#pragma once
+#ifndef STRIPE_DECODER_H_
+#define STRIPE_DECODER_H_
+
+#include <string>
+#include <vector>
+
+struct StripeImage;
+struct DecodedPoints;
+struct Calibration;
+class StripeSet;
+
+// Per pixel results of decoding the stripe images, everything that does not
+// depend on the thresholds or the calibration. They are kept per view, so a
+// threshold change only reruns the masking and triangulation.
+struct DecodeMaps
+{
+  DecodeMaps(void);
+
+  void clear(void);
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  // identifies the images the maps were computed from, set by the caller
+  std::string                 signature;
+  int                         width;
+  int                         height;
+  // the contrast is summed over this many pairs
+  int                         contrast_scale;
+  std::vector<unsigned short> contrast;
+  std::vector<unsigned short> saturation;
+  // projector column, negative where the code is not projected
+  std::vector<float>          columns;
+};
+
+// Per pixel triangulation terms, everything that depends only on the calibration, the stripe
+// set and the image size. The depth of a pixel lit by projector column c is
+//   depth = (depth_scale*c+depth_offset)/(plane_scale*c+plane_offset)
+// and its point is depth*(ray_x, ray_y, 1). The table is computed once per session and
+// kept on disk, a lens model only has to change how it is computed.
+struct RayTable
+{
+  RayTable(void);
+
+  void clear(void);
+  bool load(const std::string& filename);
+  bool save(const std::string& filename) const;
+
+  // identifies the calibration, stripe set and image size of a table
+  static std::string getSignature(const StripeSet& stripe_set, const Calibration& calibration, int width, int height);
+
+  std::string                 signature;
+  int                         width;
+  int                         height;
+  double                      depth_scale;
+  double                      depth_offset;
+  std::vector<float>          ray_x;
+  std::vector<float>          ray_y;
+  std::vector<float>          plane_scale;
+  std::vector<float>          plane_offset;
+};
+
+// Native decoder for the stripe sets of TTReg-Capture: per pixel contrast and
+// saturation masking, code and phase decoding and ray-plane triangulation.
+// The image rows are split into tiles that are decoded in parallel.
+class StripeDecoder
+{
+public:
+  StripeDecoder(void);
+  ~StripeDecoder(void);
+
+  // 0 uses one thread per core
+  inline void setThreadNumber(int thread_number) {thread_number_ = thread_number;}
+  int getThreadNumber(void) const;
+
+  // the expensive part, reading every image
+  bool computeMaps(const StripeSet& stripe_set, const std::vector<StripeImage>& images, DecodeMaps& maps) const;
+  bool computeRayTable(const StripeSet& stripe_set, const Calibration& calibration, int width, int height,
+    RayTable& ray_table) const;
+
+  // the cheap part, masking by the thresholds and triangulating
+  bool triangulate(const RayTable& ray_table, const DecodeMaps& maps,
+    int ctr_threshold, int sat_threshold, DecodedPoints& points) const;
+  // computes a ray table for this call only
+  bool triangulate(const StripeSet& stripe_set, const Calibration& calibration, const DecodeMaps& maps,
+    int ctr_threshold, int sat_threshold, DecodedPoints& points) const;
+
+  bool decode(const StripeSet& stripe_set, const Calibration& calibration, const std::vector<StripeImage>& images,
+    int ctr_threshold, int sat_threshold, DecodedPoints& points) const;
+
+private:
+  int   thread_number_;
+};
+
+#endif /*STRIPE_DECODER_H_*/
@@ -0,0 +1,63 @@
+#pragma once
+#ifndef STRIPE_SET_H_
+#define STRIPE_SET_H_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+// Description of one of the stripe sets projected by TTReg-Capture (capture/Resources).
+// All the stripes are vertical, so every image is described by one projector row.
+class StripeSet
+{
+public:
+  // the shared instance of a stripe set, NULL if the name is unknown
+  static const StripeSet* get(const std::string& name);
+
+  inline const std::string& getName(void) const {return name_;}
+  inline int getWidth(void) const {return width_;}
+  inline int getHeight(void) const {return height_;}
+  inline int getImageNumber(void) const {return (int)(rows_.size());}
+
+  // index of the all white and all black images, -1 if the set has none
+  inline int getWhiteImage(void) const {return white_;}
+  inline int getBlackImage(void) const {return black_;}
+
+  // (pattern, inverse pattern) image pairs, most significant code bit first
+  inline const std::vector<std::pair<int, int> >& getCodePairs(void) const {return code_pairs_;}
+  // projector column at the center of the run with the given code word, -1 if the code is not projected
+  inline float getCodeColumn(unsigned int code) const {return (code < code_columns_.size())?(code_columns_[code]):(-1.0f);}
+
+  // shifted square waves, used to refine the column inside a code run
+  inline const std::vector<int>& getPhaseImages(void) const {return phase_images_;}
+  inline const std::vector<float>& getPhaseShifts(void) const {return phase_shifts_;}
+  inline float getPhasePeriod(void) const {return phase_period_;}
+
+  // 1 where the projector column is lit in image
+  inline const std::vector<unsigned char>& getRow(int image) const {return rows_[image];}
+
+private:
+  StripeSet(const std::string& name, int width, int height);
+
+  int addImage(const std::vector<unsigned char>& row);
+  void addPair(const std::vector<unsigned char>& row, bool as_code);
+  void addPhaseImage(int image, int shift, int period);
+  std::vector<unsigned char> getSquareWave(int period, int shift) const;
+  void buildCodeTable(void);
+
+  static StripeSet* create(const std::string& name);
+
+  std::string                               name_;
+  int                                       width_;
+  int                                       height_;
+  int                                       white_;
+  int                                       black_;
+  std::vector<std::vector<unsigned char> >  rows_;
+  std::vector<std::pair<int, int> >         code_pairs_;
+  std::vector<float>                        code_columns_;
+  std::vector<int>                          phase_images_;
+  std::vector<float>                        phase_shifts_;
+  float                                     phase_period_;
+};
+
+#endif /*STRIPE_SET_H_*/
@@ -0,0 +1,93 @@
+#include <fstream>
+#include <sstream>
+
+#include "stripe_set.h"
+#include "calibration.h"
+
+Calibration::Calibration(void)
+  :camera_fx(0), camera_fy(0), camera_cx(-1), camera_cy(-1),
+  projector_fx(0), projector_fy(0), projector_cx(-1), projector_cy(-1)
+{
+  for (int i = 0; i < 9; ++ i)
+    rotation[i] = 0;
+  for (int i = 0; i < 3; ++ i)
+    translation[i] = 0;
+}
+
+bool Calibration::isValid(void) const
+{
+  return StripeSet::get(stripe_set) != NULL && camera_fx > 0 && camera_fy > 0
+    && projector_fx > 0 && projector_fy > 0;
+}
+
+bool Calibration::load(const std::string& filename)
+{
+  std::ifstream fin(filename.c_str());
+  if (!fin.good())
+    return false;
+
+  Calibration calibration;
+  const char* keywords[] = {"stripe_set", "camera", "projector", "rotation", "translation"};
+  const int keyword_number = (int)(sizeof(keywords)/sizeof(keywords[0]));
+  bool read_keywords[keyword_number] = {false};
+  std::string line;
+  while (std::getline(fin, line))
+  {
+    std::istringstream sin(line);
+    std::string keyword;
+    if (!(sin >> keyword) || keyword[0] == '#')
+      continue;
+
+    bool success = true;
+    if (keyword == "stripe_set")
+      success = (bool)(sin >> calibration.stripe_set);
+    else if (keyword == "camera")
+      success = (bool)(sin >> calibration.camera_fx >> calibration.camera_fy >> calibration.camera_cx >> calibration.camera_cy);
+    else if (keyword == "projector")
+      success = (bool)(sin >> calibration.projector_fx >> calibration.projector_fy >> calibration.projector_cx >> calibration.projector_cy);
+    else if (keyword == "rotation")
+    {
+      for (int i = 0; i < 9 && success; ++ i)
+        success = (bool)(sin >> calibration.rotation[i]);
+    }
+    else if (keyword == "translation")
+    {
+      for (int i = 0; i < 3 && success; ++ i)
+        success = (bool)(sin >> calibration.translation[i]);
+    }
+
+    if (!success)
+      return false;
+    for (int i = 0; i < keyword_number; ++ i)
+      read_keywords[i] = read_keywords[i] || (keyword == keywords[i]);
+  }
+
+  for (int i = 0; i < keyword_number; ++ i)
+    if (!read_keywords[i])
+      return false;
+  if (!calibration.isValid())
+    return false;
+
+  *this = calibration;
+
+  return true;
+}
+
+bool Calibration::save(const std::string& filename) const
+{
+  std::ofstream fout(filename.c_str());
+  if (!fout.good())
+    return false;
+
+  fout.precision(10);
+  fout << "stripe_set " << stripe_set << std::endl;
+  fout << "camera " << camera_fx << " " << camera_fy << " " << camera_cx << " " << camera_cy << std::endl;
+  fout << "projector " << projector_fx << " " << projector_fy << " " << projector_cx << " " << projector_cy << std::endl;
+  fout << "rotation";
+  for (int i = 0; i < 9; ++ i)
+    fout << " " << rotation[i];
+  fout << std::endl;
+  fout << "translation " << translation[0] << " " << translation[1] << " " << translation[2] << std::endl;
+
+  return fout.good();
+}
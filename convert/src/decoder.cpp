@@ -0,0 +1,700 @@
+#include <cstdio>
+#include <cstdlib>
+#include <csetjmp>
+#include <fstream>
+#include <sstream>
+#include <mutex>
+#include <algorithm>
+
+#ifdef TTREG_WITH_GCSS3DLIB
+#include "GCSS3DLib.h"
+#endif
+
+#ifdef TTREG_WITH_JPEG
+#include <jpeglib.h>
+#endif
+
+#include "stripe_set.h"
+#include "decoder.h"
+
+void DecodedPoints::clear(void)
+{
+  x.clear();
+  y.clear();
+  z.clear();
+  u.clear();
+  v.clear();
+
+  return;
+}
+
+void DecodedPoints::resize(size_t num_points)
+{
+  x.resize(num_points);
+  y.resize(num_points);
+  z.resize(num_points);
+  u.resize(num_points);
+  v.resize(num_points);
+
+  return;
+}
+
+Decoder::Decoder(void)
+  :scratch_folder_("."),
+  scratch_bytes_(0)
+{
+}
+
+Decoder::~Decoder(void)
+{
+}
+
+bool Decoder::loadCalibration(const std::string& filename)
+{
+  return calibration_.load(filename);
+}
+
+// i.bmp, or image_ii.jpg as TTReg-Capture saves them
+std::string Decoder::getStripeImageFilename(const std::string& folder, int index)
+{
+  std::ostringstream bitmap_filename;
+  bitmap_filename << folder << "/" << index << ".bmp";
+  if (std::ifstream(bitmap_filename.str().c_str()).good())
+    return bitmap_filename.str();
+
+  char capture_filename[32];
+  std::sprintf(capture_filename, "/image_%02d.jpg", index);
+
+  return folder+capture_filename;
+}
+
+bool Decoder::loadStripeImages(const std::string& folder, int image_number, std::vector<StripeImage>& images)
+{
+  images.resize(image_number);
+  for (int i = 0; i < image_number; ++ i)
+    if (!loadStripeImage(getStripeImageFilename(folder, i), images[i]))
+      return false;
+
+  return true;
+}
+
+#ifdef TTREG_WITH_GCSS3DLIB
+
+// GCSS3DLib has the calibration of the scanner built in
+bool Decoder::canDecode(void) const
+{
+  return true;
+}
+
+const StripeSet* Decoder::getStripeSet(void) const
+{
+  return StripeSet::get(calibration_.stripe_set);
+}
+
+// GCSS3DLib keeps its results in global buffers, so only one decoding may run at a time
+static std::mutex& gcss_mutex(void)
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+bool Decoder::decode(const std::string& folder, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+
+  std::string path(folder);
+  if (!path.empty() && path[path.size()-1] != '/')
+    path += "/";
+
+  // GCSS3DLib only reads bitmaps, the jpeg captures are handed over through the scratch folder
+  if (!std::ifstream((path+"0.bmp").c_str()).good())
+  {
+    const StripeSet* stripe_set = getStripeSet();
+    std::vector<StripeImage> images;
+    if (stripe_set == NULL || !loadStripeImages(folder, stripe_set->getImageNumber(), images))
+      return false;
+    return decode(images, ctr_threshold, sat_threshold, points);
+  }
+
+  std::lock_guard<std::mutex> lock(gcss_mutex());
+
+  int num_points = DecodeImgs(path.c_str(), ctr_threshold, sat_threshold);
+  if (num_points <= 0)
+    return false;
+
+  double** xc = GetXC();
+  double* image_x = GetImg_x();
+  double* image_y = GetImg_y();
+
+  points.resize(num_points);
+  for (int i = 0; i < num_points; ++ i)
+  {
+    points.x[i] = xc[0][i];
+    points.y[i] = xc[1][i];
+    points.z[i] = xc[2][i];
+    points.u[i] = image_x[i];
+    points.v[i] = image_y[i];
+  }
+
+  delete[] xc[0];
+  delete[] xc[1];
+  delete[] xc[2];
+  delete[] image_x;
+  delete[] image_y;
+
+  return true;
+}
+
+bool Decoder::decode(const std::vector<StripeImage>& images, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+  scratch_bytes_ = 0;
+
+  // GCSS3DLib only reads bitmaps from a folder, so the images go through the scratch folder
+  for (size_t i = 0, i_end = images.size(); i < i_end; ++ i)
+  {
+    std::ostringstream filename;
+    filename << scratch_folder_ << "/" << i << ".bmp";
+    if (!saveStripeImage(filename.str(), images[i]))
+      return false;
+    scratch_bytes_ += getBitmapSize(images[i]);
+  }
+
+  bool success = decode(scratch_folder_, ctr_threshold, sat_threshold, points);
+
+  for (size_t i = 0, i_end = images.size(); i < i_end; ++ i)
+  {
+    std::ostringstream filename;
+    filename << scratch_folder_ << "/" << i << ".bmp";
+    std::remove(filename.str().c_str());
+  }
+
+  return success;
+}
+
+bool Decoder::computeMaps(const std::vector<StripeImage>& images, DecodeMaps& maps)
+{
+  maps.clear();
+
+  return false;
+}
+
+bool Decoder::triangulate(const DecodeMaps& maps, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+
+  return false;
+}
+
+#else
+
+bool Decoder::canDecode(void) const
+{
+  return calibration_.isValid();
+}
+
+// NULL without a valid calibration, the native decoder has no default rig
+const StripeSet* Decoder::getStripeSet(void) const
+{
+  return calibration_.isValid()?(StripeSet::get(calibration_.stripe_set)):(NULL);
+}
+
+bool Decoder::decode(const std::string& folder, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+
+  const StripeSet* stripe_set = getStripeSet();
+  if (stripe_set == NULL)
+    return false;
+
+  std::vector<StripeImage> images;
+  if (!loadStripeImages(folder, stripe_set->getImageNumber(), images))
+    return false;
+
+  return decode(images, ctr_threshold, sat_threshold, points);
+}
+
+bool Decoder::decode(const std::vector<StripeImage>& images, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+  scratch_bytes_ = 0;
+
+  const StripeSet* stripe_set = getStripeSet();
+  if (stripe_set == NULL)
+    return false;
+
+  DecodeMaps maps;
+  if (!stripe_decoder_.computeMaps(*stripe_set, images, maps))
+    return false;
+
+  std::shared_ptr<const RayTable> ray_table = getRayTable(*stripe_set, maps.width, maps.height);
+  if (!ray_table)
+    return false;
+
+  return stripe_decoder_.triangulate(*ray_table, maps, ctr_threshold, sat_threshold, points);
+}
+
+bool Decoder::computeMaps(const std::vector<StripeImage>& images, DecodeMaps& maps)
+{
+  maps.clear();
+
+  const StripeSet* stripe_set = getStripeSet();
+  if (stripe_set == NULL)
+    return false;
+
+  return stripe_decoder_.computeMaps(*stripe_set, images, maps);
+}
+
+bool Decoder::triangulate(const DecodeMaps& maps, int ctr_threshold, int sat_threshold, DecodedPoints& points)
+{
+  points.clear();
+
+  const StripeSet* stripe_set = getStripeSet();
+  if (stripe_set == NULL)
+    return false;
+
+  std::shared_ptr<const RayTable> ray_table = getRayTable(*stripe_set, maps.width, maps.height);
+  if (!ray_table)
+    return false;
+
+  return stripe_decoder_.triangulate(*ray_table, maps, ctr_threshold, sat_threshold, points);
+}
+
+#endif /*TTREG_WITH_GCSS3DLIB*/
+
+// the camera and projector do not move during a session, so one table serves every view
+static std::mutex& ray_table_mutex(void)
+{
+  static std::mutex mutex;
+  return mutex;
+}
+
+static std::shared_ptr<const RayTable> shared_ray_table;
+
+std::shared_ptr<const RayTable> Decoder::getRayTable(const StripeSet& stripe_set, int width, int height) const
+{
+  std::string signature = RayTable::getSignature(stripe_set, calibration_, width, height);
+
+  // the other threads wait for the table instead of computing it too
+  std::lock_guard<std::mutex> lock(ray_table_mutex());
+  if (shared_ray_table && shared_ray_table->signature == signature)
+    return shared_ray_table;
+
+  std::shared_ptr<RayTable> ray_table(new RayTable);
+  std::string filename = cache_folder_.empty()?(std::string()):(cache_folder_+"/ray_table.bin");
+  if (filename.empty() || !ray_table->load(filename) || ray_table->signature != signature)
+  {
+    if (!stripe_decoder_.computeRayTable(stripe_set, calibration_, width, height, *ray_table))
+      return std::shared_ptr<const RayTable>();
+    if (!filename.empty())
+      ray_table->save(filename);
+  }
+
+  shared_ray_table = ray_table;
+
+  return shared_ray_table;
+}
+
+static void writeLE(std::ofstream& fout, unsigned int value, int bytes)
+{
+  for (int i = 0; i < bytes; ++ i)
+    fout.put(char((value >> (8*i)) & 0xFF));
+
+  return;
+}
+
+static unsigned int readLE(const unsigned char* data, int bytes)
+{
+  unsigned int value = 0;
+  for (int i = bytes-1; i >= 0; -- i)
+    value = (value << 8)|data[i];
+
+  return value;
+}
+
+#ifdef TTREG_WITH_JPEG
+
+// libjpeg exits the process on errors unless error_exit returns somewhere else
+struct JpegErrorManager
+{
+  jpeg_error_mgr  manager;
+  std::jmp_buf    jump_buffer;
+};
+
+static void exitJpegError(j_common_ptr info)
+{
+  std::longjmp(((JpegErrorManager*)(info->err))->jump_buffer, 1);
+}
+
+static bool loadJpegImage(const std::string& filename, StripeImage& image)
+{
+  FILE* file = std::fopen(filename.c_str(), "rb");
+  if (file == NULL)
+    return false;
+
+  jpeg_decompress_struct info;
+  JpegErrorManager error;
+  info.err = jpeg_std_error(&error.manager);
+  error.manager.error_exit = exitJpegError;
+  // declared before setjmp, so longjmp does not skip its destructor
+  std::vector<unsigned char> row;
+  if (setjmp(error.jump_buffer))
+  {
+    jpeg_destroy_decompress(&info);
+    std::fclose(file);
+    return false;
+  }
+
+  jpeg_create_decompress(&info);
+  jpeg_stdio_src(&info, file);
+  jpeg_read_header(&info, TRUE);
+  // gray with the weights of the bitmaps instead of the luma of libjpeg, like qGray in TTReg-Compute
+  if (info.jpeg_color_space != JCS_GRAYSCALE)
+    info.out_color_space = JCS_RGB;
+  jpeg_start_decompress(&info);
+
+  image = StripeImage(info.output_width, info.output_height);
+  row.resize(size_t(info.output_width)*info.output_components);
+  while (info.output_scanline < info.output_height)
+  {
+    unsigned char* pixels = &image.pixels[size_t(info.output_scanline)*image.width];
+    JSAMPROW rows[1] = {&row[0]};
+    jpeg_read_scanlines(&info, rows, 1);
+    if (info.output_components == 1)
+      std::copy(row.begin(), row.end(), pixels);
+    else
+    {
+      for (int x = 0; x < image.width; ++ x)
+      {
+        const unsigned char* rgb = &row[x*info.output_components];
+        pixels[x] = (unsigned char)((rgb[0]*11+rgb[1]*16+rgb[2]*5)/32);
+      }
+    }
+  }
+
+  jpeg_finish_decompress(&info);
+  jpeg_destroy_decompress(&info);
+  std::fclose(file);
+
+  return true;
+}
+
+#endif /*TTREG_WITH_JPEG*/
+
+bool Decoder::loadStripeImage(const std::string& filename, StripeImage& image)
+{
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  if (!fin.good())
+    return false;
+
+  unsigned char header[54];
+  if (!fin.read((char*)header, 2))
+    return false;
+  if (header[0] == 0xFF && header[1] == 0xD8)
+  {
+#ifdef TTREG_WITH_JPEG
+    fin.close();
+    return loadJpegImage(filename, image);
+#else
+    return false;
+#endif
+  }
+
+  if (!fin.read((char*)(header+2), sizeof(header)-2) || header[0] != 'B' || header[1] != 'M')
+    return false;
+
+  unsigned int data_offset = readLE(header+10, 4);
+  unsigned int header_size = readLE(header+14, 4);
+  int width = (int)readLE(header+18, 4);
+  int height = (int)readLE(header+22, 4);
+  unsigned int bits = readLE(header+28, 2);
+  unsigned int compression = readLE(header+30, 4);
+  unsigned int num_colors = readLE(header+46, 4);
+  if (compression != 0 || width <= 0 || height == 0 || (bits != 1 && bits != 8 && bits != 24 && bits != 32))
+    return false;
+
+  // rows are stored bottom-up unless the height is negative
+  bool bottom_up = (height > 0);
+  height = std::abs(height);
+
+  unsigned char gray_table[256];
+  for (int i = 0; i < 256; ++ i)
+    gray_table[i] = (unsigned char)i;
+  if (bits <= 8)
+  {
+    if (num_colors == 0 || num_colors > (1u<<bits))
+      num_colors = 1u<<bits;
+    std::vector<unsigned char> palette(num_colors*4);
+    fin.seekg(14+header_size, std::ios::beg);
+    if (!fin.read((char*)(&palette[0]), palette.size()))
+      return false;
+    for (unsigned int i = 0; i < num_colors; ++ i)
+      gray_table[i] = (unsigned char)((palette[4*i+2]*11+palette[4*i+1]*16+palette[4*i]*5)/32);
+  }
+
+  image = StripeImage(width, height);
+  int bytes_per_pixel = bits/8;
+  std::vector<unsigned char> row(((width*bits+31)/32)*4);
+  fin.seekg(data_offset, std::ios::beg);
+  for (int i = 0; i < height; ++ i)
+  {
+    if (!fin.read((char*)(&row[0]), row.size()))
+      return false;
+
+    unsigned char* pixels = &image.pixels[size_t(bottom_up?(height-1-i):(i))*width];
+    if (bits == 1)
+    {
+      for (int x = 0; x < width; ++ x)
+        pixels[x] = gray_table[(row[x>>3]>>(7-(x&7)))&1];
+    }
+    else if (bits == 8)
+    {
+      for (int x = 0; x < width; ++ x)
+        pixels[x] = gray_table[row[x]];
+    }
+    else
+    {
+      // same weights as qGray, the pixels are stored as BGR
+      for (int x = 0; x < width; ++ x)
+      {
+        const unsigned char* bgr = &row[x*bytes_per_pixel];
+        pixels[x] = (unsigned char)((bgr[2]*11+bgr[1]*16+bgr[0]*5)/32);
+      }
+    }
+  }
+
+  return true;
+}
+
+size_t Decoder::getBitmapSize(const StripeImage& image)
+{
+  size_t stride = (image.width+3)&(~3);
+
+  return 14+40+256*4+stride*image.height;
+}
+
+bool Decoder::saveStripeImage(const std::string& filename, const StripeImage& image)
+{
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  if (!fout.good())
+    return false;
+
+  // 8 bit bottom-up bitmap with a gray palette
+  unsigned int stride = (image.width+3)&(~3);
+  unsigned int palette_size = 256*4;
+  unsigned int data_offset = 14+40+palette_size;
+  unsigned int data_size = stride*image.height;
+
+  fout.put('B');
+  fout.put('M');
+  writeLE(fout, data_offset+data_size, 4);
+  writeLE(fout, 0, 4);
+  writeLE(fout, data_offset, 4);
+
+  writeLE(fout, 40, 4);
+  writeLE(fout, image.width, 4);
+  writeLE(fout, image.height, 4);
+  writeLE(fout, 1, 2);
+  writeLE(fout, 8, 2);
+  writeLE(fout, 0, 4);
+  writeLE(fout, data_size, 4);
+  writeLE(fout, 2835, 4);
+  writeLE(fout, 2835, 4);
+  writeLE(fout, 256, 4);
+  writeLE(fout, 0, 4);
+
+  for (unsigned int i = 0; i < 256; ++ i)
+    writeLE(fout, (i<<16)|(i<<8)|i, 4);
+
+  std::vector<char> padding(stride-image.width, 0);
+  for (int y = image.height-1; y >= 0; -- y)
+  {
+    fout.write((const char*)(&image.pixels[size_t(y)*image.width]), image.width);
+    if (!padding.empty())
+      fout.write(&padding[0], padding.size());
+  }
+
+  return fout.good();
+}
+
+PointsHeader::PointsHeader(void)
+  :size(0),
+  version(0),
+  single_precision(false),
+  count(0)
+{
+  for (int i = 0; i < 3; ++ i)
+  {
+    min[i] = 0;
+    max[i] = 0;
+  }
+}
+
+static const char points_magic[6] = {'B', 'X', 'Y', 'Z', 'U', 'V'};
+// version 1 had no padding, so its double records were not aligned when mapped
+static const unsigned short points_version = 2;
+// magic, version, precision, padding, count and bounds, a multiple of 8 so mapped records are aligned
+static const size_t points_header_size = 6+2+4+4+8+6*8;
+static const size_t points_header_size_v1 = 6+2+4+8+6*8;
+// points per write
+static const size_t points_chunk_size = 1<<16;
+
+template <class Real>
+static void fillPointsChunk(const DecodedPoints& points, size_t begin, size_t end, char* buffer)
+{
+  Real* records = (Real*)buffer;
+  for (size_t i = begin; i < end; ++ i, records += 5)
+  {
+    records[0] = (Real)points.x[i];
+    records[1] = (Real)points.y[i];
+    records[2] = (Real)points.z[i];
+    records[3] = (Real)points.u[i];
+    records[4] = (Real)points.v[i];
+  }
+
+  return;
+}
+
+template <class Real>
+static void readPointsChunk(const char* buffer, size_t begin, size_t end, DecodedPoints& points)
+{
+  const Real* records = (const Real*)buffer;
+  for (size_t i = begin; i < end; ++ i, records += 5)
+  {
+    points.x[i] = records[0];
+    points.y[i] = records[1];
+    points.z[i] = records[2];
+    points.u[i] = records[3];
+    points.v[i] = records[4];
+  }
+
+  return;
+}
+
+bool Decoder::savePoints(const std::string& filename, const DecodedPoints& points, bool single_precision)
+{
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  if (!fout.good())
+    return false;
+
+  PointsHeader header;
+  header.single_precision = single_precision;
+  header.count = points.size();
+  if (!points.x.empty())
+  {
+    header.min[0] = header.max[0] = points.x[0];
+    header.min[1] = header.max[1] = points.y[0];
+    header.min[2] = header.max[2] = points.z[0];
+  }
+  for (size_t i = 0, i_end = points.size(); i < i_end; ++ i)
+  {
+    double coordinates[3] = {points.x[i], points.y[i], points.z[i]};
+    for (int j = 0; j < 3; ++ j)
+    {
+      header.min[j] = std::min(header.min[j], coordinates[j]);
+      header.max[j] = std::max(header.max[j], coordinates[j]);
+    }
+  }
+
+  unsigned int precision = single_precision?(1):(0);
+  unsigned int padding = 0;
+  fout.write(points_magic, sizeof(points_magic));
+  fout.write((const char*)(&points_version), sizeof(points_version));
+  fout.write((const char*)(&precision), sizeof(precision));
+  fout.write((const char*)(&padding), sizeof(padding));
+  fout.write((const char*)(&header.count), sizeof(header.count));
+  fout.write((const char*)(header.min), sizeof(header.min));
+  fout.write((const char*)(header.max), sizeof(header.max));
+
+  size_t record_size = header.getRecordSize();
+  std::vector<char> buffer(std::min(points.size(), points_chunk_size)*record_size);
+  for (size_t begin = 0, num_points = points.size(); begin < num_points; begin += points_chunk_size)
+  {
+    size_t end = std::min(begin+points_chunk_size, num_points);
+    if (single_precision)
+      fillPointsChunk<float>(points, begin, end, &buffer[0]);
+    else
+      fillPointsChunk<double>(points, begin, end, &buffer[0]);
+    fout.write(&buffer[0], (end-begin)*record_size);
+  }
+
+  return fout.good();
+}
+
+bool Decoder::parsePointsHeader(const char* data, size_t data_size, size_t file_size, PointsHeader& header)
+{
+  header = PointsHeader();
+
+  // only files without the magic are taken for the headerless doubles of GCSS3DLib times,
+  // a damaged or newer header is an error instead of points read from the header bytes
+  if (data_size < sizeof(points_magic) || !std::equal(points_magic, points_magic+6, data))
+  {
+    header.count = file_size/header.getRecordSize();
+    return file_size%header.getRecordSize() == 0;
+  }
+
+  if (data_size < 8)
+    return false;
+  unsigned short version;
+  std::copy(data+6, data+8, (char*)(&version));
+  size_t size = (version == 1)?(points_header_size_v1):(points_header_size);
+  if ((version != 1 && version != points_version) || data_size < size)
+    return false;
+
+  // the fields after the precision are shifted by the padding of version 2
+  size_t offset = (version == 1)?(12):(16);
+  unsigned int precision;
+  std::copy(data+8, data+12, (char*)(&precision));
+  std::copy(data+offset, data+offset+8, (char*)(&header.count));
+  std::copy(data+offset+8, data+offset+32, (char*)(header.min));
+  std::copy(data+offset+32, data+offset+56, (char*)(header.max));
+
+  header.size = size;
+  header.version = version;
+  header.single_precision = (precision != 0);
+
+  return precision <= 1 && file_size == header.size+header.count*header.getRecordSize();
+}
+
+bool Decoder::loadPoints(const std::string& filename, DecodedPoints& points)
+{
+  points.clear();
+
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  if (!fin.good())
+    return false;
+
+  fin.seekg(0, std::ios::end);
+  size_t file_size = (size_t)(fin.tellg());
+  fin.seekg(0, std::ios::beg);
+
+  char data[points_header_size];
+  size_t data_size = std::min(file_size, points_header_size);
+  fin.read(data, data_size);
+
+  PointsHeader header;
+  if (!fin.good() || !parsePointsHeader(data, data_size, file_size, header))
+    return false;
+
+  fin.seekg(header.size, std::ios::beg);
+  points.resize(header.count);
+
+  size_t record_size = header.getRecordSize();
+  std::vector<char> buffer(std::min((size_t)(header.count), points_chunk_size)*record_size);
+  for (size_t begin = 0, num_points = points.size(); begin < num_points; begin += points_chunk_size)
+  {
+    size_t end = std::min(begin+points_chunk_size, num_points);
+    if (!fin.read(&buffer[0], (end-begin)*record_size))
+    {
+      points.clear();
+      return false;
+    }
+
+    if (header.single_precision)
+      readPointsChunk<float>(&buffer[0], begin, end, points);
+    else
+      readPointsChunk<double>(&buffer[0], begin, end, points);
+  }
+
+  return true;
+}
@@ -1,72 +1,267 @@
 #include <iostream>
 #include <fstream>
+#include <sstream>
 #include <string>
-#include <limits>
-#include <iomanip>
+#include <vector>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 
-#include "GCSS3DLib.h"
+#include "decoder.h"
 
-int main(int argc, char *argv[])
+static void printUsage(const char* argv0)
+{
+  std::string exe_filename(argv0);
+  size_t pos = exe_filename.find_last_of("/\\");
+  if (pos != std::string::npos) {
+    exe_filename = exe_filename.substr(pos+1);
+  }
+  std::cout << "[TTReg-Convert]-Usage: " << exe_filename << " image_folder ctr_threshold sat_threshold [float] [--calibration filename]" << std::endl;
+  std::cout << "[TTReg-Convert]-Usage: " << exe_filename << " --batch ctr_threshold sat_threshold [options] items..." << std::endl;
+  std::cout << "  items are image folders, @manifest files with one image folder per line, or" << std::endl;
+  std::cout << "  --range images_folder start_frame end_frame view_number for images_folder/frame_xxxxx/view_xx" << std::endl;
+  std::cout << "  of a workspace, saved in points/frame_xxxxx/view_xx next to images_folder" << std::endl;
+  std::cout << "  options: --float, --threads n (0 for one per core), --calibration filename" << std::endl;
+  std::cout << "  the native decoder needs the calibration file of the scanner, see calibration.h" << std::endl;
+}
+
+// the calibration is only optional for GCSS3DLib, which has it built in
+static bool setCalibration(Decoder& decoder, const std::string& filename)
 {
-  if (argc != 4) {
-    std::string exe_filename(argv[0]);
-    size_t pos = exe_filename.find_last_of('/');
-    if (pos != std::string::npos) {
-      exe_filename = exe_filename.substr(pos+1);
+  if (!filename.empty() && !decoder.loadCalibration(filename)) {
+    std::cout << "Cannot read calibration [" << filename << "]" << std::endl;
+    return false;
+  }
+  if (!decoder.canDecode()) {
+    std::cout << "No calibration, it is given with --calibration filename" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+// the images of a view and the folder its points are saved in
+struct ConvertItem
+{
+  ConvertItem(const std::string& images, const std::string& points):images_folder(images),points_folder(points){}
+
+  std::string images_folder;
+  std::string points_folder;
+};
+
+// one folder per line, empty lines and lines starting with # are skipped, the points are saved with the images
+static bool readManifest(const std::string& filename, std::vector<ConvertItem>& items)
+{
+  std::ifstream fin(filename.c_str());
+  if (!fin.good())
+    return false;
+
+  std::string line;
+  while (std::getline(fin, line))
+  {
+    size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+      continue;
+    size_t end = line.find_last_not_of(" \t\r");
+    std::string folder = line.substr(begin, end-begin+1);
+    items.push_back(ConvertItem(folder, folder));
+  }
+
+  return true;
+}
+
+// the view folders of a workspace, older captures name them slice_xx, the points of every view
+// go to the same folder under points, where TTReg-Compute reads them, false if images_folder
+// is not the images folder of a workspace
+static bool addRange(const std::string& images_folder, int start_frame, int end_frame, int view_number,
+  std::vector<ConvertItem>& items)
+{
+  std::string root(images_folder);
+  while (root.size() > 1 && (root[root.size()-1] == '/' || root[root.size()-1] == '\\'))
+    root.erase(root.size()-1);
+  size_t pos = root.find_last_of("/\\");
+  size_t name_begin = (pos == std::string::npos)?(0):(pos+1);
+  if (root.substr(name_begin) != "images")
+    return false;
+  std::string points_root = root.substr(0, name_begin)+"points";
+
+  for (int frame = start_frame; frame <= end_frame; ++ frame)
+  {
+    for (int view = 0; view < view_number; ++ view)
+    {
+      char frame_folder[32], slice_folder[32], view_folder[32];
+      std::sprintf(frame_folder, "/frame_%05d", frame);
+      std::sprintf(slice_folder, "/slice_%02d", view);
+      std::sprintf(view_folder, "/view_%02d", view);
+
+      std::string view_path = std::string(frame_folder)+slice_folder;
+      if (!std::ifstream(Decoder::getStripeImageFilename(root+view_path, 0).c_str()).good())
+        view_path = std::string(frame_folder)+view_folder;
+      items.push_back(ConvertItem(root+view_path, points_root+view_path));
     }
-    std::cout << "[TTReg-Convert]-Usage: " << exe_filename << " image_folder ctr_threshold sat_threshold" << std::endl;
+  }
+
+  return true;
+}
+
+static bool convertFolder(Decoder& decoder, const ConvertItem& item, int ctr_threshold, int sat_threshold,
+  bool single_precision, size_t& num_points)
+{
+  DecodedPoints points;
+  bool success = decoder.decode(item.images_folder, ctr_threshold, sat_threshold, points);
+  num_points = points.size();
+  if (!success)
+    return false;
+
+  return Decoder::savePoints(item.points_folder+"/points.bxyzuv", points, single_precision);
+}
+
+// the folders are handed out to a fixed pool of workers, each keeping its decoder for all of them
+static int runBatch(int argc, char *argv[])
+{
+  if (argc < 5) {
+    printUsage(argv[0]);
     return 1;
   }
 
-  std::string folder(argv[1]);
-  folder += "/";
   int ctr_threshold = atoi(argv[2]);
   int sat_threshold = atoi(argv[3]);
+  bool single_precision = false;
+  int thread_number = 0;
+  std::string calibration_filename;
+  std::vector<ConvertItem> items;
 
-  int num_points = 0;
-  std::cout << "Decoding images in folder [" << folder << "]"
-    << " with ctr_threshold=" << ctr_threshold
-    << " and sat_threshold=" << sat_threshold << "...";
-  num_points = DecodeImgs(folder.c_str(), ctr_threshold, sat_threshold);
-  std::cout << "Done with " << num_points << " points." << std::endl;
+  for (int i = 4; i < argc; ++ i)
+  {
+    std::string argument(argv[i]);
+    if (argument == "--float")
+      single_precision = true;
+    else if (argument == "--threads" && i+1 < argc)
+      thread_number = atoi(argv[++ i]);
+    else if (argument == "--calibration" && i+1 < argc)
+      calibration_filename = argv[++ i];
+    else if (argument == "--range" && i+4 < argc)
+    {
+      std::string images_folder(argv[i+1]);
+      if (!addRange(images_folder, atoi(argv[i+2]), atoi(argv[i+3]), atoi(argv[i+4]), items)) {
+        std::cout << "[" << images_folder << "] is not the images folder of a workspace" << std::endl;
+        return 1;
+      }
+      i += 4;
+    }
+    else if (argument[0] == '@')
+    {
+      if (!readManifest(argument.substr(1), items)) {
+        std::cout << "Cannot read manifest [" << argument.substr(1) << "]" << std::endl;
+        return 1;
+      }
+    }
+    else if (argument.compare(0, 2, "--") == 0)
+    {
+      printUsage(argv[0]);
+      return 1;
+    }
+    else
+      items.push_back(ConvertItem(argument, argument));
+  }
 
-  if(num_points == 0)
-	  return 1;
+  Decoder calibration_decoder;
+  if (!setCalibration(calibration_decoder, calibration_filename))
+    return 1;
+  const Calibration& calibration = calibration_decoder.getCalibration();
 
-  double **points ;
-  points = GetXC();
+  int num_folders = (int)(items.size());
+  int num_cores = std::max(1, (int)(std::thread::hardware_concurrency()));
+  if (thread_number <= 0)
+    thread_number = num_cores;
+  thread_number = std::max(1, std::min(thread_number, num_folders));
 
-  double *image_x;
-  double *image_y;
-  image_x = GetImg_x();
-  image_y = GetImg_y();
+  std::cout << "Converting " << num_folders << " folders with ctr_threshold=" << ctr_threshold
+    << " and sat_threshold=" << sat_threshold << " on " << thread_number << " threads..." << std::endl;
 
-  std::string filename = folder+"points.bxyzuv";
-  std::cout << "Saving points to " << filename << "...";
-  std::ofstream fout(filename.c_str(), std::ios::binary);
+  std::mutex output_mutex;
+  std::atomic<int> next_folder(0);
+  std::atomic<int> num_failed(0);
+  auto worker = [&]() {
+    Decoder decoder;
+    decoder.setCalibration(calibration);
+    // the cores are shared by the workers instead of every decoder using all of them
+    decoder.setThreadNumber(std::max(1, num_cores/thread_number));
 
+    for (int i = next_folder++; i < num_folders; i = next_folder++)
+    {
+      size_t num_points = 0;
+      bool success = convertFolder(decoder, items[i], ctr_threshold, sat_threshold, single_precision, num_points);
+      if (!success)
+        num_failed ++;
 
-  for (int i = 0; i < num_points; ++ i)
+      std::lock_guard<std::mutex> lock(output_mutex);
+      std::cout << "[" << items[i].images_folder << "] " << (success?"Done":"Failed") << " with " << num_points << " points." << std::endl;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1; i < thread_number; ++ i)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (size_t i = 0, i_end = threads.size(); i < i_end; ++ i)
+    threads[i].join();
+
+  std::cout << "Converted " << num_folders-num_failed << " of " << num_folders << " folders." << std::endl;
+
+  return (num_failed == 0)?(0):(1);
+}
+
+int main(int argc, char *argv[])
+{
+  if (argc > 1 && std::string(argv[1]) == "--batch")
+    return runBatch(argc, argv);
+
+  if (argc < 4) {
+    printUsage(argv[0]);
+    return 1;
+  }
+
+  std::string folder(argv[1]);
+  folder += "/";
+  int ctr_threshold = atoi(argv[2]);
+  int sat_threshold = atoi(argv[3]);
+  bool single_precision = false;
+  std::string calibration_filename;
+  for (int i = 4; i < argc; ++ i)
   {
-	  for(int j = 0; j < 3; ++ j)
-	  {
-		  double value = points[j][i];
-		  fout.write((const char*)(&value), sizeof(double));
-	  }
-	  double u = image_x[i];
-	  double v = image_y[i];
-	  fout.write((const char*)(&u), sizeof(double));
-	  fout.write((const char*)(&v), sizeof(double));
+    std::string argument(argv[i]);
+    if (argument == "float")
+      single_precision = true;
+    else if (argument == "--calibration" && i+1 < argc)
+      calibration_filename = argv[++ i];
+    else {
+      printUsage(argv[0]);
+      return 1;
+    }
   }
-  std::cout << "Done." << std::endl;
 
-  delete[] points[0];
-  delete[] points[1];
-  delete[] points[2];
-  delete[] image_x;
-  delete[] image_y;
+  Decoder decoder;
+  if (!setCalibration(decoder, calibration_filename))
+    return 1;
+  DecodedPoints points;
+  std::cout << "Decoding images in folder [" << folder << "]"
+    << " with ctr_threshold=" << ctr_threshold
+    << " and sat_threshold=" << sat_threshold << "...";
+  bool success = decoder.decode(folder, ctr_threshold, sat_threshold, points);
+  std::cout << "Done with " << points.size() << " points." << std::endl;
+
+  if (!success)
+    return 1;
 
-  fout.close();
+  std::string filename = folder+"points.bxyzuv";
+  std::cout << "Saving points to " << filename << "...";
+  if (!Decoder::savePoints(filename, points, single_precision))
+    return 1;
+  std::cout << "Done." << std::endl;
 
   return 0;
 }
@@ -0,0 +1,716 @@
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STRIPE_DECODER_SSE2
+#endif
+
+#include "decoder.h"
+#include "stripe_set.h"
+#include "calibration.h"
+#include "stripe_decoder.h"
+
+static const double pi = 3.14159265358979323846;
+
+// rays nearly parallel to a light plane give huge depths
+static const double max_depth = 1e5;
+
+// rows decoded by one task, small enough to balance the threads and keep the rows of all images in cache
+static const int tile_rows = 16;
+
+// the images of the maps computation, shared read-only by all the threads
+struct MapsContext
+{
+  const StripeSet*                  stripe_set;
+  std::vector<const unsigned char*> images;
+  // per phase image weights of the phase estimation
+  std::vector<float>                phase_sin;
+  std::vector<float>                phase_cos;
+};
+
+// the calibration the ray table is computed from, with the principal points resolved
+struct RayContext
+{
+  double                            camera_fx, camera_fy, camera_cx, camera_cy;
+  double                            projector_fx, projector_cx;
+  double                            rotation[9];
+  double                            translation[3];
+};
+
+// contrast = white-black and saturation = white+black
+static void computeReference(const unsigned char* white, const unsigned char* black, int width,
+  unsigned short* contrast, unsigned short* saturation)
+{
+  int i = 0;
+#ifdef STRIPE_DECODER_SSE2
+  __m128i zero = _mm_setzero_si128();
+  for (; i+16 <= width; i += 16)
+  {
+    __m128i w = _mm_loadu_si128((const __m128i*)(white+i));
+    __m128i b = _mm_loadu_si128((const __m128i*)(black+i));
+    __m128i c = _mm_subs_epu8(w, b);
+    _mm_storeu_si128((__m128i*)(contrast+i), _mm_unpacklo_epi8(c, zero));
+    _mm_storeu_si128((__m128i*)(contrast+i+8), _mm_unpackhi_epi8(c, zero));
+    _mm_storeu_si128((__m128i*)(saturation+i), _mm_add_epi16(_mm_unpacklo_epi8(w, zero), _mm_unpacklo_epi8(b, zero)));
+    _mm_storeu_si128((__m128i*)(saturation+i+8), _mm_add_epi16(_mm_unpackhi_epi8(w, zero), _mm_unpackhi_epi8(b, zero)));
+  }
+#endif
+  for (; i < width; ++ i)
+  {
+    contrast[i] = (white[i] > black[i])?(white[i]-black[i]):(0);
+    saturation[i] = white[i]+black[i];
+  }
+
+  return;
+}
+
+// contrast += |pattern-inverse| and saturation = max(saturation, pattern+inverse)
+static void accumulatePair(const unsigned char* pattern, const unsigned char* inverse, int width,
+  unsigned short* contrast, unsigned short* saturation)
+{
+  int i = 0;
+#ifdef STRIPE_DECODER_SSE2
+  __m128i zero = _mm_setzero_si128();
+  for (; i+16 <= width; i += 16)
+  {
+    __m128i p = _mm_loadu_si128((const __m128i*)(pattern+i));
+    __m128i n = _mm_loadu_si128((const __m128i*)(inverse+i));
+    __m128i d = _mm_or_si128(_mm_subs_epu8(p, n), _mm_subs_epu8(n, p));
+
+    __m128i* c = (__m128i*)(contrast+i);
+    _mm_storeu_si128(c, _mm_add_epi16(_mm_loadu_si128(c), _mm_unpacklo_epi8(d, zero)));
+    _mm_storeu_si128(c+1, _mm_add_epi16(_mm_loadu_si128(c+1), _mm_unpackhi_epi8(d, zero)));
+
+    // sums are at most 510, so the signed max is fine
+    __m128i* s = (__m128i*)(saturation+i);
+    __m128i s_lo = _mm_add_epi16(_mm_unpacklo_epi8(p, zero), _mm_unpacklo_epi8(n, zero));
+    __m128i s_hi = _mm_add_epi16(_mm_unpackhi_epi8(p, zero), _mm_unpackhi_epi8(n, zero));
+    _mm_storeu_si128(s, _mm_max_epi16(_mm_loadu_si128(s), s_lo));
+    _mm_storeu_si128(s+1, _mm_max_epi16(_mm_loadu_si128(s+1), s_hi));
+  }
+#endif
+  for (; i < width; ++ i)
+  {
+    contrast[i] += (pattern[i] > inverse[i])?(pattern[i]-inverse[i]):(inverse[i]-pattern[i]);
+    saturation[i] = std::max(saturation[i], (unsigned short)(pattern[i]+inverse[i]));
+  }
+
+  return;
+}
+
+// code = (code<<1)|(pattern > inverse)
+static void accumulateCodeBit(const unsigned char* pattern, const unsigned char* inverse, int width, unsigned short* code)
+{
+  int i = 0;
+#ifdef STRIPE_DECODER_SSE2
+  __m128i zero = _mm_setzero_si128();
+  __m128i one = _mm_set1_epi8(1);
+  for (; i+16 <= width; i += 16)
+  {
+    __m128i p = _mm_loadu_si128((const __m128i*)(pattern+i));
+    __m128i n = _mm_loadu_si128((const __m128i*)(inverse+i));
+    // pattern <= inverse exactly where max(pattern, inverse) == inverse
+    __m128i bit = _mm_andnot_si128(_mm_cmpeq_epi8(_mm_max_epu8(p, n), n), one);
+
+    __m128i* c = (__m128i*)(code+i);
+    _mm_storeu_si128(c, _mm_or_si128(_mm_slli_epi16(_mm_loadu_si128(c), 1), _mm_unpacklo_epi8(bit, zero)));
+    _mm_storeu_si128(c+1, _mm_or_si128(_mm_slli_epi16(_mm_loadu_si128(c+1), 1), _mm_unpackhi_epi8(bit, zero)));
+  }
+#endif
+  for (; i < width; ++ i)
+    code[i] = (unsigned short)((code[i]<<1)|((pattern[i] > inverse[i])?(1):(0)));
+
+  return;
+}
+
+static void accumulatePhase(const unsigned char* image, float weight_sin, float weight_cos, int width,
+  float* phase_sin, float* phase_cos)
+{
+  for (int i = 0; i < width; ++ i)
+  {
+    float intensity = image[i];
+    phase_sin[i] += intensity*weight_sin;
+    phase_cos[i] += intensity*weight_cos;
+  }
+
+  return;
+}
+
+static void computeMapsTile(const MapsContext& context, int row_begin, int row_end, DecodeMaps& maps)
+{
+  const StripeSet& stripe_set = *context.stripe_set;
+  const std::vector<std::pair<int, int> >& code_pairs = stripe_set.getCodePairs();
+  const std::vector<int>& phase_images = stripe_set.getPhaseImages();
+  int white = stripe_set.getWhiteImage();
+  int black = stripe_set.getBlackImage();
+  float period = stripe_set.getPhasePeriod();
+  float radian_to_column = period/(2*(float)(pi));
+
+  int width = maps.width;
+  std::vector<unsigned short> code(width);
+  std::vector<float> phase_sin(width), phase_cos(width);
+
+  for (int y = row_begin; y < row_end; ++ y)
+  {
+    size_t offset = size_t(y)*width;
+    unsigned short* contrast = &maps.contrast[offset];
+    unsigned short* saturation = &maps.saturation[offset];
+    float* columns = &maps.columns[offset];
+
+    if (white >= 0 && black >= 0)
+      computeReference(context.images[white]+offset, context.images[black]+offset, width, contrast, saturation);
+    else
+    {
+      std::fill(contrast, contrast+width, 0);
+      std::fill(saturation, saturation+width, 0);
+      for (size_t i = 0, i_end = code_pairs.size(); i < i_end; ++ i)
+        accumulatePair(context.images[code_pairs[i].first]+offset, context.images[code_pairs[i].second]+offset,
+          width, contrast, saturation);
+    }
+
+    std::fill(code.begin(), code.end(), 0);
+    for (size_t i = 0, i_end = code_pairs.size(); i < i_end; ++ i)
+      accumulateCodeBit(context.images[code_pairs[i].first]+offset, context.images[code_pairs[i].second]+offset,
+        width, &code[0]);
+
+    std::fill(phase_sin.begin(), phase_sin.end(), 0.0f);
+    std::fill(phase_cos.begin(), phase_cos.end(), 0.0f);
+    for (size_t i = 0, i_end = phase_images.size(); i < i_end; ++ i)
+      accumulatePhase(context.images[phase_images[i]]+offset, context.phase_sin[i], context.phase_cos[i],
+        width, &phase_sin[0], &phase_cos[0]);
+
+    // the code gives the run, the phase the position inside it
+    for (int x = 0; x < width; ++ x)
+    {
+      float coarse = stripe_set.getCodeColumn(code[x]);
+      if (coarse < 0)
+      {
+        columns[x] = -1.0f;
+        continue;
+      }
+
+      float column = coarse;
+      if (period > 0)
+      {
+        float phase = std::atan2(phase_cos[x], -phase_sin[x])*radian_to_column;
+        column = phase+period*std::floor((coarse-phase)/period+0.5f);
+      }
+
+      // pixel centers at integer columns, like the calibration
+      columns[x] = std::max(column-0.5f, 0.0f);
+    }
+  }
+
+  return;
+}
+
+// with X_p = R*X+t and the light plane of column c at a = (c-projector_cx)/projector_fx,
+// the camera ray depth*r meets the plane where (R0-a*R6)*r_x+(R1-a*R7)*r_y+(R2-a*R8) times
+// depth equals a*t2-t0, both sides are affine in c
+static void computeRayTableTile(const RayContext& context, int row_begin, int row_end, RayTable& ray_table)
+{
+  const double* R = context.rotation;
+  double a_scale = 1.0/context.projector_fx;
+  double a_offset = -context.projector_cx/context.projector_fx;
+
+  int width = ray_table.width;
+  for (int y = row_begin; y < row_end; ++ y)
+  {
+    size_t offset = size_t(y)*width;
+    double ray_y = (y-context.camera_cy)/context.camera_fy;
+    for (int x = 0; x < width; ++ x)
+    {
+      double ray_x = (x-context.camera_cx)/context.camera_fx;
+      double p = R[0]*ray_x+R[1]*ray_y+R[2];
+      double q = R[6]*ray_x+R[7]*ray_y+R[8];
+      ray_table.ray_x[offset+x] = (float)(ray_x);
+      ray_table.ray_y[offset+x] = (float)(ray_y);
+      ray_table.plane_scale[offset+x] = (float)(-a_scale*q);
+      ray_table.plane_offset[offset+x] = (float)(p-a_offset*q);
+    }
+  }
+
+  return;
+}
+
+static void triangulateTile(const RayTable& ray_table, const DecodeMaps& maps, int ctr_threshold, int sat_threshold,
+  int row_begin, int row_end, DecodedPoints& points)
+{
+  int width = maps.width;
+  ctr_threshold *= maps.contrast_scale;
+
+  std::vector<int> valid_pixels;
+  std::vector<float> valid_columns;
+  std::vector<double> depths;
+  valid_pixels.reserve(width);
+  valid_columns.reserve(width);
+  depths.reserve(width);
+
+  // at most every pixel of the tile, so the points are never reallocated
+  size_t max_points = size_t(row_end-row_begin)*width;
+  points.x.reserve(max_points);
+  points.y.reserve(max_points);
+  points.z.reserve(max_points);
+  points.u.reserve(max_points);
+  points.v.reserve(max_points);
+
+  for (int y = row_begin; y < row_end; ++ y)
+  {
+    size_t offset = size_t(y)*width;
+    const unsigned short* contrast = &maps.contrast[offset];
+    const unsigned short* saturation = &maps.saturation[offset];
+    const float* columns = &maps.columns[offset];
+
+    valid_pixels.clear();
+    valid_columns.clear();
+    for (int x = 0; x < width; ++ x)
+    {
+      if (contrast[x] < ctr_threshold || saturation[x] > sat_threshold || columns[x] < 0)
+        continue;
+
+      valid_pixels.push_back(x);
+      valid_columns.push_back(columns[x]);
+    }
+
+    // two multiply-adds and a division per pixel, branch free so the loop vectorizes,
+    // invalid depths are filtered afterwards
+    const float* plane_scale = &ray_table.plane_scale[offset];
+    const float* plane_offset = &ray_table.plane_offset[offset];
+    double depth_scale = ray_table.depth_scale;
+    double depth_offset = ray_table.depth_offset;
+    int num_valid = (int)(valid_pixels.size());
+    depths.resize(num_valid);
+    for (int i = 0; i < num_valid; ++ i)
+    {
+      int x = valid_pixels[i];
+      double column = valid_columns[i];
+      depths[i] = (depth_scale*column+depth_offset)/(plane_scale[x]*column+plane_offset[x]);
+    }
+
+    const float* ray_x = &ray_table.ray_x[offset];
+    const float* ray_y = &ray_table.ray_y[offset];
+    for (int i = 0; i < num_valid; ++ i)
+    {
+      double depth = depths[i];
+      if (!(depth > 0) || depth > max_depth)
+        continue;
+
+      int x = valid_pixels[i];
+      points.x.push_back(depth*ray_x[x]);
+      points.y.push_back(depth*ray_y[x]);
+      points.z.push_back(depth);
+      points.u.push_back(x);
+      points.v.push_back(y);
+    }
+  }
+
+  return;
+}
+
+// run task(tile) for every tile, on the calling thread and num_threads-1 others
+template <class Task>
+static void runTiles(int num_tiles, int num_threads, const Task& task)
+{
+  std::atomic<int> next_tile(0);
+  auto worker = [&]() {
+    for (int tile = next_tile++; tile < num_tiles; tile = next_tile++)
+      task(tile);
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 1, i_end = std::min(num_threads, num_tiles); i < i_end; ++ i)
+    threads.push_back(std::thread(worker));
+  worker();
+  for (size_t i = 0, i_end = threads.size(); i < i_end; ++ i)
+    threads[i].join();
+
+  return;
+}
+
+DecodeMaps::DecodeMaps(void)
+  :width(0),
+  height(0),
+  contrast_scale(1)
+{
+}
+
+void DecodeMaps::clear(void)
+{
+  signature.clear();
+  width = height = 0;
+  contrast_scale = 1;
+  contrast.clear();
+  saturation.clear();
+  columns.clear();
+
+  return;
+}
+
+static const char maps_magic[4] = {'T', 'T', 'R', 'M'};
+static const int maps_version = 1;
+
+bool DecodeMaps::load(const std::string& filename)
+{
+  clear();
+
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  if (!fin.good())
+    return false;
+
+  char magic[4];
+  int version, signature_size;
+  fin.read(magic, sizeof(magic));
+  fin.read((char*)(&version), sizeof(version));
+  fin.read((char*)(&signature_size), sizeof(signature_size));
+  if (!fin.good() || !std::equal(magic, magic+4, maps_magic) || version != maps_version
+    || signature_size < 0 || signature_size > (1<<20))
+    return false;
+
+  std::string file_signature(signature_size, ' ');
+  int file_width, file_height, file_contrast_scale;
+  if (signature_size > 0)
+    fin.read(&file_signature[0], signature_size);
+  fin.read((char*)(&file_width), sizeof(file_width));
+  fin.read((char*)(&file_height), sizeof(file_height));
+  fin.read((char*)(&file_contrast_scale), sizeof(file_contrast_scale));
+  if (!fin.good() || file_width <= 0 || file_height <= 0)
+    return false;
+
+  size_t size = size_t(file_width)*file_height;
+  contrast.resize(size);
+  saturation.resize(size);
+  columns.resize(size);
+  fin.read((char*)(&contrast[0]), size*sizeof(unsigned short));
+  fin.read((char*)(&saturation[0]), size*sizeof(unsigned short));
+  fin.read((char*)(&columns[0]), size*sizeof(float));
+  if (!fin.good())
+  {
+    clear();
+    return false;
+  }
+
+  signature = file_signature;
+  width = file_width;
+  height = file_height;
+  contrast_scale = file_contrast_scale;
+
+  return true;
+}
+
+bool DecodeMaps::save(const std::string& filename) const
+{
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  if (!fout.good())
+    return false;
+
+  int signature_size = (int)(signature.size());
+  size_t size = size_t(width)*height;
+  fout.write(maps_magic, sizeof(maps_magic));
+  fout.write((const char*)(&maps_version), sizeof(maps_version));
+  fout.write((const char*)(&signature_size), sizeof(signature_size));
+  fout.write(signature.data(), signature_size);
+  fout.write((const char*)(&width), sizeof(width));
+  fout.write((const char*)(&height), sizeof(height));
+  fout.write((const char*)(&contrast_scale), sizeof(contrast_scale));
+  if (size > 0)
+  {
+    fout.write((const char*)(&contrast[0]), size*sizeof(unsigned short));
+    fout.write((const char*)(&saturation[0]), size*sizeof(unsigned short));
+    fout.write((const char*)(&columns[0]), size*sizeof(float));
+  }
+
+  return fout.good();
+}
+
+RayTable::RayTable(void)
+  :width(0),
+  height(0),
+  depth_scale(0),
+  depth_offset(0)
+{
+}
+
+void RayTable::clear(void)
+{
+  signature.clear();
+  width = height = 0;
+  depth_scale = depth_offset = 0;
+  ray_x.clear();
+  ray_y.clear();
+  plane_scale.clear();
+  plane_offset.clear();
+
+  return;
+}
+
+std::string RayTable::getSignature(const StripeSet& stripe_set, const Calibration& calibration, int width, int height)
+{
+  std::ostringstream signature;
+  signature.precision(17);
+  signature << stripe_set.getName() << " " << width << "x" << height
+    << " camera " << calibration.camera_fx << " " << calibration.camera_fy
+    << " " << calibration.camera_cx << " " << calibration.camera_cy
+    << " projector " << calibration.projector_fx << " " << calibration.projector_fy
+    << " " << calibration.projector_cx << " " << calibration.projector_cy << " rotation";
+  for (int i = 0; i < 9; ++ i)
+    signature << " " << calibration.rotation[i];
+  signature << " translation";
+  for (int i = 0; i < 3; ++ i)
+    signature << " " << calibration.translation[i];
+
+  return signature.str();
+}
+
+static const char rays_magic[4] = {'T', 'T', 'R', 'R'};
+static const int rays_version = 1;
+
+bool RayTable::load(const std::string& filename)
+{
+  clear();
+
+  std::ifstream fin(filename.c_str(), std::ios::binary);
+  if (!fin.good())
+    return false;
+
+  char magic[4];
+  int version, signature_size;
+  fin.read(magic, sizeof(magic));
+  fin.read((char*)(&version), sizeof(version));
+  fin.read((char*)(&signature_size), sizeof(signature_size));
+  if (!fin.good() || !std::equal(magic, magic+4, rays_magic) || version != rays_version
+    || signature_size < 0 || signature_size > (1<<20))
+    return false;
+
+  std::string file_signature(signature_size, ' ');
+  int file_width, file_height;
+  double file_depth_scale, file_depth_offset;
+  if (signature_size > 0)
+    fin.read(&file_signature[0], signature_size);
+  fin.read((char*)(&file_width), sizeof(file_width));
+  fin.read((char*)(&file_height), sizeof(file_height));
+  fin.read((char*)(&file_depth_scale), sizeof(file_depth_scale));
+  fin.read((char*)(&file_depth_offset), sizeof(file_depth_offset));
+  if (!fin.good() || file_width <= 0 || file_height <= 0)
+    return false;
+
+  size_t size = size_t(file_width)*file_height;
+  ray_x.resize(size);
+  ray_y.resize(size);
+  plane_scale.resize(size);
+  plane_offset.resize(size);
+  fin.read((char*)(&ray_x[0]), size*sizeof(float));
+  fin.read((char*)(&ray_y[0]), size*sizeof(float));
+  fin.read((char*)(&plane_scale[0]), size*sizeof(float));
+  fin.read((char*)(&plane_offset[0]), size*sizeof(float));
+  if (!fin.good())
+  {
+    clear();
+    return false;
+  }
+
+  signature = file_signature;
+  width = file_width;
+  height = file_height;
+  depth_scale = file_depth_scale;
+  depth_offset = file_depth_offset;
+
+  return true;
+}
+
+bool RayTable::save(const std::string& filename) const
+{
+  std::ofstream fout(filename.c_str(), std::ios::binary);
+  if (!fout.good())
+    return false;
+
+  int signature_size = (int)(signature.size());
+  size_t size = size_t(width)*height;
+  fout.write(rays_magic, sizeof(rays_magic));
+  fout.write((const char*)(&rays_version), sizeof(rays_version));
+  fout.write((const char*)(&signature_size), sizeof(signature_size));
+  fout.write(signature.data(), signature_size);
+  fout.write((const char*)(&width), sizeof(width));
+  fout.write((const char*)(&height), sizeof(height));
+  fout.write((const char*)(&depth_scale), sizeof(depth_scale));
+  fout.write((const char*)(&depth_offset), sizeof(depth_offset));
+  if (size > 0)
+  {
+    fout.write((const char*)(&ray_x[0]), size*sizeof(float));
+    fout.write((const char*)(&ray_y[0]), size*sizeof(float));
+    fout.write((const char*)(&plane_scale[0]), size*sizeof(float));
+    fout.write((const char*)(&plane_offset[0]), size*sizeof(float));
+  }
+
+  return fout.good();
+}
+
+StripeDecoder::StripeDecoder(void)
+  :thread_number_(0)
+{
+}
+
+StripeDecoder::~StripeDecoder(void)
+{
+}
+
+int StripeDecoder::getThreadNumber(void) const
+{
+  if (thread_number_ > 0)
+    return thread_number_;
+
+  return std::max(1, (int)(std::thread::hardware_concurrency()));
+}
+
+bool StripeDecoder::computeMaps(const StripeSet& stripe_set, const std::vector<StripeImage>& images, DecodeMaps& maps) const
+{
+  maps.clear();
+
+  if (images.empty() || (int)(images.size()) != stripe_set.getImageNumber())
+    return false;
+
+  MapsContext context;
+  context.stripe_set = &stripe_set;
+  int width = images[0].width;
+  int height = images[0].height;
+  if (width <= 0 || height <= 0)
+    return false;
+  for (size_t i = 0, i_end = images.size(); i < i_end; ++ i)
+  {
+    const StripeImage& image = images[i];
+    if (image.width != width || image.height != height || image.pixels.size() != size_t(width)*height)
+      return false;
+    context.images.push_back(&image.pixels[0]);
+  }
+
+  const std::vector<float>& phase_shifts = stripe_set.getPhaseShifts();
+  for (size_t i = 0, i_end = phase_shifts.size(); i < i_end; ++ i)
+  {
+    double angle = 2*pi*phase_shifts[i]/stripe_set.getPhasePeriod();
+    context.phase_sin.push_back((float)std::sin(angle));
+    context.phase_cos.push_back((float)std::cos(angle));
+  }
+
+  // without white and black images, the contrast is summed over the pairs
+  maps.width = width;
+  maps.height = height;
+  bool has_reference = (stripe_set.getWhiteImage() >= 0 && stripe_set.getBlackImage() >= 0);
+  maps.contrast_scale = has_reference?(1):((int)(stripe_set.getCodePairs().size()));
+  maps.contrast.resize(size_t(width)*height);
+  maps.saturation.resize(size_t(width)*height);
+  maps.columns.resize(size_t(width)*height);
+
+  int num_tiles = (height+tile_rows-1)/tile_rows;
+  runTiles(num_tiles, getThreadNumber(), [&](int tile) {
+    int row_begin = tile*tile_rows;
+    computeMapsTile(context, row_begin, std::min(row_begin+tile_rows, height), maps);
+  });
+
+  return true;
+}
+
+bool StripeDecoder::computeRayTable(const StripeSet& stripe_set, const Calibration& calibration, int width, int height,
+  RayTable& ray_table) const
+{
+  ray_table.clear();
+
+  if (width <= 0 || height <= 0)
+    return false;
+
+  RayContext context;
+  context.camera_fx = calibration.camera_fx;
+  context.camera_fy = calibration.camera_fy;
+  context.camera_cx = (calibration.camera_cx < 0)?(0.5*(width-1)):(calibration.camera_cx);
+  context.camera_cy = (calibration.camera_cy < 0)?(0.5*(height-1)):(calibration.camera_cy);
+  context.projector_fx = calibration.projector_fx;
+  context.projector_cx = (calibration.projector_cx < 0)?(0.5*(stripe_set.getWidth()-1)):(calibration.projector_cx);
+  std::copy(calibration.rotation, calibration.rotation+9, context.rotation);
+  std::copy(calibration.translation, calibration.translation+3, context.translation);
+
+  ray_table.signature = RayTable::getSignature(stripe_set, calibration, width, height);
+  ray_table.width = width;
+  ray_table.height = height;
+  const double* t = context.translation;
+  ray_table.depth_scale = t[2]/context.projector_fx;
+  ray_table.depth_offset = -context.projector_cx/context.projector_fx*t[2]-t[0];
+  ray_table.ray_x.resize(size_t(width)*height);
+  ray_table.ray_y.resize(size_t(width)*height);
+  ray_table.plane_scale.resize(size_t(width)*height);
+  ray_table.plane_offset.resize(size_t(width)*height);
+
+  int num_tiles = (height+tile_rows-1)/tile_rows;
+  runTiles(num_tiles, getThreadNumber(), [&](int tile) {
+    int row_begin = tile*tile_rows;
+    computeRayTableTile(context, row_begin, std::min(row_begin+tile_rows, height), ray_table);
+  });
+
+  return true;
+}
+
+bool StripeDecoder::triangulate(const RayTable& ray_table, const DecodeMaps& maps,
+  int ctr_threshold, int sat_threshold, DecodedPoints& points) const
+{
+  points.clear();
+
+  size_t size = size_t(maps.width)*maps.height;
+  if (size == 0 || maps.contrast.size() != size || maps.saturation.size() != size || maps.columns.size() != size)
+    return false;
+  if (ray_table.width != maps.width || ray_table.height != maps.height || ray_table.plane_offset.size() != size)
+    return false;
+
+  int num_tiles = (maps.height+tile_rows-1)/tile_rows;
+  std::vector<DecodedPoints> tile_points(num_tiles);
+  runTiles(num_tiles, getThreadNumber(), [&](int tile) {
+    int row_begin = tile*tile_rows;
+    triangulateTile(ray_table, maps, ctr_threshold, sat_threshold,
+      row_begin, std::min(row_begin+tile_rows, maps.height), tile_points[tile]);
+  });
+
+  // keep the row major order of the single threaded decoding
+  size_t num_points = 0;
+  for (int i = 0; i < num_tiles; ++ i)
+    num_points += tile_points[i].size();
+  points.resize(num_points);
+
+  size_t offset = 0;
+  for (int i = 0; i < num_tiles; ++ i)
+  {
+    const DecodedPoints& tile = tile_points[i];
+    std::copy(tile.x.begin(), tile.x.end(), points.x.begin()+offset);
+    std::copy(tile.y.begin(), tile.y.end(), points.y.begin()+offset);
+    std::copy(tile.z.begin(), tile.z.end(), points.z.begin()+offset);
+    std::copy(tile.u.begin(), tile.u.end(), points.u.begin()+offset);
+    std::copy(tile.v.begin(), tile.v.end(), points.v.begin()+offset);
+    offset += tile.size();
+  }
+
+  return num_points > 0;
+}
+
+bool StripeDecoder::triangulate(const StripeSet& stripe_set, const Calibration& calibration, const DecodeMaps& maps,
+  int ctr_threshold, int sat_threshold, DecodedPoints& points) const
+{
+  points.clear();
+
+  RayTable ray_table;
+  if (!computeRayTable(stripe_set, calibration, maps.width, maps.height, ray_table))
+    return false;
+
+  return triangulate(ray_table, maps, ctr_threshold, sat_threshold, points);
+}
+
+bool StripeDecoder::decode(const StripeSet& stripe_set, const Calibration& calibration, const std::vector<StripeImage>& images,
+  int ctr_threshold, int sat_threshold, DecodedPoints& points) const
+{
+  points.clear();
+
+  DecodeMaps maps;
+  if (!computeMaps(stripe_set, images, maps))
+    return false;
+
+  return triangulate(stripe_set, calibration, maps, ctr_threshold, sat_threshold, points);
+}
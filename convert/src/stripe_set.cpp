@@ -0,0 +1,157 @@
+#include <map>
+#include <memory>
+
+#include "stripe_set.h"
+
+StripeSet::StripeSet(const std::string& name, int width, int height)
+  :name_(name),
+  width_(width),
+  height_(height),
+  white_(-1),
+  black_(-1),
+  phase_period_(0)
+{
+}
+
+int StripeSet::addImage(const std::vector<unsigned char>& row)
+{
+  rows_.push_back(row);
+
+  return (int)(rows_.size())-1;
+}
+
+void StripeSet::addPair(const std::vector<unsigned char>& row, bool as_code)
+{
+  std::vector<unsigned char> inverse(row.size());
+  for (size_t i = 0, i_end = row.size(); i < i_end; ++ i)
+    inverse[i] = 1-row[i];
+
+  int pattern = addImage(row);
+  int inverse_pattern = addImage(inverse);
+  if (as_code)
+    code_pairs_.push_back(std::make_pair(pattern, inverse_pattern));
+
+  return;
+}
+
+void StripeSet::addPhaseImage(int image, int shift, int period)
+{
+  phase_images_.push_back(image);
+  phase_shifts_.push_back((float)shift);
+  phase_period_ = (float)period;
+
+  return;
+}
+
+// lit on [shift, shift+period/2) modulo period
+std::vector<unsigned char> StripeSet::getSquareWave(int period, int shift) const
+{
+  std::vector<unsigned char> row(width_);
+  for (int i = 0; i < width_; ++ i)
+    row[i] = (((i-shift)%period+period)%period < period/2)?(1):(0);
+
+  return row;
+}
+
+// the code word of every projector column, mapped back to the center of its run
+void StripeSet::buildCodeTable(void)
+{
+  int num_bits = (int)(code_pairs_.size());
+  code_columns_.assign(size_t(1)<<num_bits, -1.0f);
+
+  std::vector<int> first(code_columns_.size(), -1);
+  std::vector<int> last(code_columns_.size(), -1);
+  for (int i = 0; i < width_; ++ i)
+  {
+    unsigned int code = 0;
+    for (int j = 0; j < num_bits; ++ j)
+      code = (code<<1)|rows_[code_pairs_[j].first][i];
+
+    if (first[code] < 0)
+      first[code] = i;
+    last[code] = i;
+  }
+
+  for (size_t i = 0, i_end = code_columns_.size(); i < i_end; ++ i)
+    if (first[i] >= 0)
+      code_columns_[i] = 0.5f*(first[i]+last[i]+1);
+
+  return;
+}
+
+StripeSet* StripeSet::create(const std::string& name)
+{
+  StripeSet* stripe_set = NULL;
+
+  if (name == "1024x768x30" || name == "800x600x30")
+  {
+    // white, black, 10 bit Gray code pairs and 8 shifts of a square wave with period 8
+    stripe_set = (name == "1024x768x30")?(new StripeSet(name, 1024, 768)):(new StripeSet(name, 800, 600));
+    int width = stripe_set->width_;
+    stripe_set->white_ = stripe_set->addImage(std::vector<unsigned char>(width, 1));
+    stripe_set->black_ = stripe_set->addImage(std::vector<unsigned char>(width, 0));
+
+    for (int bit = 9; bit >= 0; -- bit)
+    {
+      std::vector<unsigned char> row(width);
+      for (int i = 0; i < width; ++ i)
+        row[i] = (((i^(i>>1))>>bit)&1)?(0):(1);
+      stripe_set->addPair(row, true);
+    }
+
+    int shifts[] = {4, 5, 6, 7, 0, 1, 2, 3};
+    for (int i = 0; i < 8; ++ i)
+    {
+      int image = stripe_set->addImage(stripe_set->getSquareWave(8, shifts[i]));
+      stripe_set->addPhaseImage(image, shifts[i], 8);
+    }
+  }
+  else if (name == "1024x768x24")
+  {
+    // no white and black images, 8 code pairs and 8 shifts of a square wave with period 8;
+    // the code pairs are a 7 bit Gray code of 8 column blocks xor a square wave carrier with period 16,
+    // followed by the carrier, so the code word is unique for every run of 4 columns
+    stripe_set = new StripeSet(name, 1024, 768);
+    int width = stripe_set->width_;
+
+    std::vector<unsigned char> carrier = stripe_set->getSquareWave(16, 4);
+    for (int bit = 6; bit >= -1; -- bit)
+    {
+      std::vector<unsigned char> row(carrier);
+      if (bit >= 0)
+      {
+        for (int i = 0; i < width; ++ i)
+          row[i] ^= (((i>>3)^(i>>4))>>bit)&1;
+      }
+      stripe_set->addPair(row, true);
+    }
+
+    for (int shift = 0; shift < 4; ++ shift)
+    {
+      stripe_set->addPair(stripe_set->getSquareWave(8, shift), false);
+      int image = stripe_set->getImageNumber()-2;
+      stripe_set->addPhaseImage(image, shift, 8);
+      stripe_set->addPhaseImage(image+1, shift+4, 8);
+    }
+  }
+
+  if (stripe_set != NULL)
+    stripe_set->buildCodeTable();
+
+  return stripe_set;
+}
+
+const StripeSet* StripeSet::get(const std::string& name)
+{
+  static const char* names[] = {"800x600x30", "1024x768x24", "1024x768x30"};
+  static std::map<std::string, std::shared_ptr<StripeSet> > stripe_sets = [] {
+    std::map<std::string, std::shared_ptr<StripeSet> > stripe_sets;
+    for (size_t i = 0; i < sizeof(names)/sizeof(names[0]); ++ i)
+      stripe_sets[names[i]].reset(create(names[i]));
+    return stripe_sets;
+  }();
+
+  std::map<std::string, std::shared_ptr<StripeSet> >::const_iterator it = stripe_sets.find(name);
+
+  return (it == stripe_sets.end())?(NULL):(it->second.get());
+}
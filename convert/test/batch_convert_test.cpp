@@ -0,0 +1,183 @@
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+#include <jpeglib.h>
+
+#include "synthetic_stripes.h"
+
+// Lays out a workspace the way TTReg-Capture saves a frame, images/frame_00000/view_xx/image_xx.jpg,
+// runs TTReg-Convert --batch --range on it and checks the points it saves in points/frame_00000/view_xx.
+
+static const int ctr_threshold = 20;
+static const int sat_threshold = 500;
+// the jpeg captures lose a little contrast on the stripe edges
+static const double min_coverage = 0.9;
+static const double max_mean_error = 0.5;
+
+// as TTReg-Capture saves them, in color at quality 100
+static bool saveJpegImage(const std::string& filename, const StripeImage& image)
+{
+  FILE* file = std::fopen(filename.c_str(), "wb");
+  if (file == NULL)
+    return false;
+
+  jpeg_compress_struct info;
+  jpeg_error_mgr error;
+  info.err = jpeg_std_error(&error);
+  jpeg_create_compress(&info);
+  jpeg_stdio_dest(&info, file);
+  info.image_width = image.width;
+  info.image_height = image.height;
+  info.input_components = 3;
+  info.in_color_space = JCS_RGB;
+  jpeg_set_defaults(&info);
+  jpeg_set_quality(&info, 100, TRUE);
+  jpeg_start_compress(&info, TRUE);
+
+  std::vector<unsigned char> row(size_t(image.width)*3);
+  while (info.next_scanline < info.image_height)
+  {
+    const unsigned char* pixels = &image.pixels[size_t(info.next_scanline)*image.width];
+    for (int x = 0; x < image.width; ++ x)
+      row[3*x] = row[3*x+1] = row[3*x+2] = pixels[x];
+    JSAMPROW rows[1] = {&row[0]};
+    jpeg_write_scanlines(&info, rows, 1);
+  }
+
+  jpeg_finish_compress(&info);
+  jpeg_destroy_compress(&info);
+  std::fclose(file);
+
+  return true;
+}
+
+static std::string getViewPath(int view)
+{
+  char view_path[32];
+  std::sprintf(view_path, "/frame_00000/view_%02d", view);
+
+  return view_path;
+}
+
+static bool check(const std::string& workspace, int view, const Target& target, const Camera& camera,
+  const std::vector<double>& depths)
+{
+  std::string images_folder = workspace+"/images"+getViewPath(view);
+  std::string points_folder = workspace+"/points"+getViewPath(view);
+
+  if (std::ifstream((images_folder+"/points.bxyzuv").c_str()).good())
+  {
+    std::cout << "view " << view << ": points saved in the images folder FAILED" << std::endl;
+    return false;
+  }
+
+  DecodedPoints points;
+  if (!Decoder::loadPoints(points_folder+"/points.bxyzuv", points))
+  {
+    std::cout << "view " << view << ": no points in " << points_folder << " FAILED" << std::endl;
+    return false;
+  }
+
+  size_t lit_pixels = 0;
+  for (size_t i = 0, i_end = depths.size(); i < i_end; ++ i)
+    if (depths[i] > 0)
+      lit_pixels ++;
+
+  size_t measured_points = 0;
+  double mean_error = 0;
+  for (size_t i = 0, i_end = points.size(); i < i_end; ++ i)
+  {
+    size_t offset = size_t(points.v[i])*camera.width+size_t(points.u[i]);
+    if (depths[offset] <= 0)
+      continue;
+    mean_error += std::abs(points.z[i]-depths[offset]);
+    measured_points ++;
+  }
+  double coverage = (lit_pixels > 0)?(double(measured_points)/lit_pixels):(0.0);
+  mean_error = (measured_points > 0)?(mean_error/measured_points):(0.0);
+
+  bool success = (coverage >= min_coverage) && (mean_error <= max_mean_error);
+  std::cout << "view " << view << " " << target.getName() << ": " << points.size() << " points, coverage "
+    << coverage << ", depth error mean " << mean_error << "mm" << (success?(""):(" FAILED")) << std::endl;
+
+  return success;
+}
+
+// TTReg-Convert and a workspace with the folders of two views in images and points
+int main(int argc, char *argv[])
+{
+  if (argc != 3)
+  {
+    std::cout << "Usage: " << argv[0] << " TTReg-Convert workspace" << std::endl;
+    return 1;
+  }
+  std::string convert(argv[1]);
+  std::string workspace(argv[2]);
+
+  Calibration calibration = getNominalCalibration("1024x768x30");
+  const StripeSet* stripe_set = StripeSet::get(calibration.stripe_set);
+  if (stripe_set == NULL || !calibration.save(workspace+"/calibration.txt"))
+    return 1;
+  Camera camera = getCamera(*stripe_set, calibration);
+
+  PlaneTarget plane;
+  SphereTarget sphere;
+  const Target* targets[] = {&plane, &sphere};
+  int view_number = (int)(sizeof(targets)/sizeof(targets[0]));
+
+  std::vector<std::vector<double> > depths(view_number);
+  for (int view = 0; view < view_number; ++ view)
+  {
+    std::vector<StripeImage> images;
+    std::vector<bool> reached;
+    render(*stripe_set, calibration, camera, *targets[view], images, depths[view], reached);
+
+    std::string images_folder = workspace+"/images"+getViewPath(view);
+    for (size_t i = 0, i_end = images.size(); i < i_end; ++ i)
+    {
+      char filename[32];
+      std::sprintf(filename, "/image_%02d.jpg", (int)(i));
+      if (!saveJpegImage(images_folder+filename, images[i]))
+      {
+        std::cout << "Cannot write " << images_folder+filename << std::endl;
+        return 1;
+      }
+    }
+    std::remove((images_folder+"/points.bxyzuv").c_str());
+    std::remove((workspace+"/points"+getViewPath(view)+"/points.bxyzuv").c_str());
+  }
+
+  // there is no default rig, so it does not decode without the calibration
+  std::ostringstream command;
+  command << "\"" << convert << "\" --batch " << ctr_threshold << " " << sat_threshold
+    << " --range \"" << workspace << "/images\" 0 0 " << view_number;
+  std::cout << command.str() << std::endl;
+  if (std::system(command.str().c_str()) == 0
+    || std::ifstream((workspace+"/points"+getViewPath(0)+"/points.bxyzuv").c_str()).good())
+  {
+    std::cout << "TTReg-Convert without calibration FAILED" << std::endl;
+    return 1;
+  }
+
+  command.str("");
+  command << "\"" << convert << "\" --batch " << ctr_threshold << " " << sat_threshold
+    << " --calibration \"" << workspace << "/calibration.txt\" --range \"" << workspace << "/images\" 0 0 " << view_number;
+  std::cout << command.str() << std::endl;
+  if (std::system(command.str().c_str()) != 0)
+  {
+    std::cout << "TTReg-Convert FAILED" << std::endl;
+    return 1;
+  }
+
+  bool success = true;
+  for (int view = 0; view < view_number; ++ view)
+    success = check(workspace, view, *targets[view], camera, depths[view]) && success;
+
+  return success?(0):(1);
+}
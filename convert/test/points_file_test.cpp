@@ -0,0 +1,112 @@
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+#include "decoder.h"
+
+// Saves and loads points.bxyzuv files, and checks that damaged or unknown headers are rejected
+// instead of being read as the headerless doubles of GCSS3DLib times.
+
+static const char* filename = "points_file_test.bxyzuv";
+
+static bool readFile(std::vector<char>& data)
+{
+  std::ifstream fin(filename, std::ios::binary);
+  data.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+
+  return !data.empty();
+}
+
+static bool writeFile(const std::vector<char>& data)
+{
+  std::ofstream fout(filename, std::ios::binary);
+  fout.write(&data[0], data.size());
+
+  return fout.good();
+}
+
+static bool parse(const std::vector<char>& data, PointsHeader& header)
+{
+  return Decoder::parsePointsHeader(&data[0], data.size(), data.size(), header);
+}
+
+static bool check(const std::string& name, bool success)
+{
+  std::cout << name << (success?(""):(" FAILED")) << std::endl;
+
+  return success;
+}
+
+static bool samePoints(const DecodedPoints& a, const DecodedPoints& b, double tolerance)
+{
+  if (a.size() != b.size())
+    return false;
+  for (size_t i = 0, i_end = a.size(); i < i_end; ++ i)
+    if (std::abs(a.x[i]-b.x[i]) > tolerance || std::abs(a.v[i]-b.v[i]) > tolerance)
+      return false;
+
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  DecodedPoints points;
+  points.resize(100);
+  for (size_t i = 0; i < points.size(); ++ i)
+  {
+    points.x[i] = 0.5*i;
+    points.y[i] = -0.25*i;
+    points.z[i] = 900+i;
+    points.u[i] = i%10;
+    points.v[i] = i/10;
+  }
+
+  bool success = true;
+  std::vector<char> data;
+  PointsHeader header;
+  DecodedPoints loaded;
+
+  for (int precision = 0; precision < 2; ++ precision)
+  {
+    std::string name = precision?("float"):("double");
+    Decoder::savePoints(filename, points, precision == 1);
+    success = check(name+" round trip", Decoder::loadPoints(filename, loaded) && samePoints(points, loaded, 1e-3)) && success;
+    success = check(name+" records aligned", readFile(data) && parse(data, header) && header.size%8 == 0) && success;
+  }
+
+  // a newer version with a longer header and a cut file, both with sizes that divide by the
+  // size of a double record, so they would pass for headerless doubles
+  Decoder::savePoints(filename, points);
+  readFile(data);
+  parse(data, header);
+  std::vector<char> newer(data);
+  newer[6] = 3;
+  newer.insert(newer.begin()+header.size, 8, 0);
+  success = check("newer version rejected", newer.size()%40 == 0 && writeFile(newer)
+    && !Decoder::loadPoints(filename, loaded)) && success;
+  std::vector<char> truncated(data.begin(), data.end()-32);
+  success = check("truncated file rejected", truncated.size()%40 == 0 && writeFile(truncated)
+    && !Decoder::loadPoints(filename, loaded)) && success;
+  std::vector<char> header_only(data.begin(), data.begin()+40);
+  success = check("cut header rejected", writeFile(header_only) && !Decoder::loadPoints(filename, loaded)) && success;
+
+  // version 1 headers had no padding before the count
+  std::vector<char> version_1(data.begin(), data.begin()+12);
+  version_1[6] = 1;
+  version_1.insert(version_1.end(), data.begin()+16, data.end());
+  success = check("version 1 read", writeFile(version_1) && Decoder::loadPoints(filename, loaded)
+    && samePoints(points, loaded, 1e-9)) && success;
+
+  // records without a header
+  std::vector<char> headerless(data.begin()+header.size, data.end());
+  success = check("headerless read", writeFile(headerless) && Decoder::loadPoints(filename, loaded)
+    && samePoints(points, loaded, 1e-9)) && success;
+
+  std::remove(filename);
+
+  return success?(0):(1);
+}
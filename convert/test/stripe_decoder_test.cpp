@@ -0,0 +1,104 @@
+#include <cmath>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+
+#include "stripe_decoder.h"
+#include "synthetic_stripes.h"
+
+// Renders the stripe images of a target with known geometry through the nominal calibration,
+// decodes them with StripeDecoder and checks the mask and the depths against the geometry.
+
+static const int ctr_threshold = 20;
+static const int sat_threshold = 500;
+// required fraction of the lit target pixels that are decoded, and depth errors in millimeters;
+// 1024x768x24 has no white and black images, so the pixels on the edges of its carrier, which
+// are edges in every pair, have no contrast and are masked
+static const double min_coverage = 0.95;
+static const double max_mean_error = 0.5;
+static const double max_error_percentile = 2.0;
+
+static bool test(const std::string& stripe_set_name, const Target& target)
+{
+  const StripeSet* stripe_set = StripeSet::get(stripe_set_name);
+  if (stripe_set == NULL)
+  {
+    std::cout << stripe_set_name << ": unknown stripe set" << std::endl;
+    return false;
+  }
+
+  Calibration calibration = getNominalCalibration(stripe_set_name);
+
+  Camera camera = getCamera(*stripe_set, calibration);
+
+  std::vector<StripeImage> images;
+  std::vector<double> depths;
+  std::vector<bool> reached;
+  render(*stripe_set, calibration, camera, target, images, depths, reached);
+
+  StripeDecoder decoder;
+  DecodedPoints points;
+  if (!decoder.decode(*stripe_set, calibration, images, ctr_threshold, sat_threshold, points))
+  {
+    std::cout << stripe_set_name << " " << target.getName() << ": decoding failed" << std::endl;
+    return false;
+  }
+
+  size_t lit_pixels = 0;
+  for (size_t i = 0, i_end = depths.size(); i < i_end; ++ i)
+    if (depths[i] > 0)
+      lit_pixels ++;
+
+  // points where no light reaches the target are false positives, the errors are in depth and
+  // only measured where the pixel center is lit, the pixels on the edges have no single depth
+  size_t false_points = 0;
+  std::vector<double> errors;
+  errors.reserve(points.size());
+  for (size_t i = 0, i_end = points.size(); i < i_end; ++ i)
+  {
+    size_t offset = size_t(points.v[i])*camera.width+size_t(points.u[i]);
+    if (!reached[offset])
+      false_points ++;
+    else if (depths[offset] > 0)
+      errors.push_back(std::abs(points.z[i]-depths[offset]));
+  }
+
+  double coverage = (lit_pixels > 0)?(double(errors.size())/lit_pixels):(0.0);
+  double mean_error = 0;
+  for (size_t i = 0, i_end = errors.size(); i < i_end; ++ i)
+    mean_error += errors[i];
+  mean_error = errors.empty()?(0.0):(mean_error/errors.size());
+  double error_percentile = 0;
+  if (!errors.empty())
+  {
+    std::vector<double>::iterator percentile = errors.begin()+(errors.size()*99)/100;
+    std::nth_element(errors.begin(), percentile, errors.end());
+    error_percentile = *percentile;
+  }
+
+  bool success = (coverage >= min_coverage) && (false_points == 0)
+    && (mean_error <= max_mean_error) && (error_percentile <= max_error_percentile);
+
+  std::cout << stripe_set_name << " " << target.getName() << ": "
+    << points.size() << " points, coverage " << coverage << " of " << lit_pixels << " lit pixels, "
+    << false_points << " false points, depth error mean " << mean_error << "mm 99% " << error_percentile << "mm"
+    << (success?(""):(" FAILED")) << std::endl;
+
+  return success;
+}
+
+int main(int argc, char *argv[])
+{
+  const char* stripe_sets[] = {"800x600x30", "1024x768x24", "1024x768x30"};
+  PlaneTarget plane;
+  SphereTarget sphere;
+  const Target* targets[] = {&plane, &sphere};
+
+  bool success = true;
+  for (size_t i = 0; i < sizeof(stripe_sets)/sizeof(stripe_sets[0]); ++ i)
+    for (size_t j = 0; j < sizeof(targets)/sizeof(targets[0]); ++ j)
+      success = test(stripe_sets[i], *targets[j]) && success;
+
+  return success?(0):(1);
+}
@@ -0,0 +1,186 @@
+#pragma once
+#ifndef SYNTHETIC_STRIPES_H_
+#define SYNTHETIC_STRIPES_H_
+
+#include <cmath>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+#include "decoder.h"
+#include "stripe_set.h"
+#include "calibration.h"
+
+// Targets with known geometry and the stripe images the camera sees of them through a calibration,
+// shared by the tests.
+
+// gray levels of an unlit and a lit projector column on the target
+static const double dark_level = 20;
+static const double lit_level = 200;
+// samples per camera pixel in each direction
+static const int supersampling = 4;
+
+// a made up rig, with the projector 200mm right of the camera and converging at about 900mm,
+// the images are rendered and decoded through the same one
+static Calibration getNominalCalibration(const std::string& stripe_set)
+{
+  Calibration calibration;
+  calibration.stripe_set = stripe_set;
+  calibration.camera_fx = calibration.camera_fy = 1600;
+  calibration.projector_fx = calibration.projector_fy = 1600;
+
+  double baseline = 200;
+  double angle = std::atan2(baseline, 900.0);
+  double c = std::cos(angle), s = std::sin(angle);
+  double rotation_y[9] = {c, 0, s, 0, 1, 0, -s, 0, c};
+  std::copy(rotation_y, rotation_y+9, calibration.rotation);
+  calibration.translation[0] = -baseline*c;
+  calibration.translation[1] = 0;
+  calibration.translation[2] = baseline*s;
+
+  return calibration;
+}
+
+class Target
+{
+public:
+  virtual ~Target(void) {}
+  virtual std::string getName(void) const = 0;
+  // depth of the camera ray depth*(ray_x, ray_y, 1) at the target, negative if it is missed
+  virtual double intersect(double ray_x, double ray_y) const = 0;
+};
+
+// a plane tilted about the vertical axis, so the columns are not constant along the rows
+class PlaneTarget : public Target
+{
+public:
+  virtual std::string getName(void) const {return "plane";}
+  virtual double intersect(double ray_x, double ray_y) const
+  {
+    // z = distance+slope*x
+    const double distance = 900, slope = 0.2;
+    return distance/(1-slope*ray_x);
+  }
+};
+
+class SphereTarget : public Target
+{
+public:
+  virtual std::string getName(void) const {return "sphere";}
+  virtual double intersect(double ray_x, double ray_y) const
+  {
+    const double center_z = 900, radius = 200;
+    // |depth*r-c|^2 = radius^2 with c = (0, 0, center_z), the near root
+    double a = ray_x*ray_x+ray_y*ray_y+1;
+    double b = -2*center_z;
+    double c = center_z*center_z-radius*radius;
+    double discriminant = b*b-4*a*c;
+    if (discriminant < 0)
+      return -1;
+    return (-b-std::sqrt(discriminant))/(2*a);
+  }
+};
+
+struct Camera
+{
+  int     width;
+  int     height;
+  double  fx, fy, cx, cy;
+};
+
+// the camera of the calibration, with as many pixels as the projector and centered
+static Camera getCamera(const StripeSet& stripe_set, const Calibration& calibration)
+{
+  Camera camera;
+  camera.width = stripe_set.getWidth();
+  camera.height = stripe_set.getHeight();
+  camera.fx = calibration.camera_fx;
+  camera.fy = calibration.camera_fy;
+  camera.cx = 0.5*(camera.width-1);
+  camera.cy = 0.5*(camera.height-1);
+
+  return camera;
+}
+
+// the projector pixel that lights a camera space point, false if it is outside of the projector
+static bool project(const StripeSet& stripe_set, const Calibration& calibration, const double* point, int& column)
+{
+  const double* R = calibration.rotation;
+  const double* t = calibration.translation;
+  double x = R[0]*point[0]+R[1]*point[1]+R[2]*point[2]+t[0];
+  double y = R[3]*point[0]+R[4]*point[1]+R[5]*point[2]+t[1];
+  double z = R[6]*point[0]+R[7]*point[1]+R[8]*point[2]+t[2];
+  if (z <= 0)
+    return false;
+
+  double cx = (calibration.projector_cx < 0)?(0.5*(stripe_set.getWidth()-1)):(calibration.projector_cx);
+  double cy = (calibration.projector_cy < 0)?(0.5*(stripe_set.getHeight()-1)):(calibration.projector_cy);
+  // pixel centers at integer coordinates
+  double u = calibration.projector_fx*x/z+cx;
+  double v = calibration.projector_fy*y/z+cy;
+  column = (int)(std::floor(u+0.5));
+  int row = (int)(std::floor(v+0.5));
+
+  return column >= 0 && column < stripe_set.getWidth() && row >= 0 && row < stripe_set.getHeight();
+}
+
+// every pixel averages supersampling^2 samples, depths are those of the pixel centers lit by the
+// projector and reached marks the pixels with any lit sample
+static void render(const StripeSet& stripe_set, const Calibration& calibration, const Camera& camera,
+  const Target& target, std::vector<StripeImage>& images, std::vector<double>& depths, std::vector<bool>& reached)
+{
+  int image_number = stripe_set.getImageNumber();
+  images.assign(image_number, StripeImage(camera.width, camera.height));
+  depths.assign(size_t(camera.width)*camera.height, -1.0);
+  reached.assign(size_t(camera.width)*camera.height, false);
+
+  std::vector<int> columns;
+  std::vector<double> intensities(image_number);
+  for (int y = 0; y < camera.height; ++ y)
+  {
+    for (int x = 0; x < camera.width; ++ x)
+    {
+      size_t offset = size_t(y)*camera.width+x;
+
+      double center_depth = target.intersect((x-camera.cx)/camera.fx, (y-camera.cy)/camera.fy);
+      if (center_depth > 0)
+      {
+        double point[3] = {center_depth*(x-camera.cx)/camera.fx, center_depth*(y-camera.cy)/camera.fy, center_depth};
+        int column;
+        if (project(stripe_set, calibration, point, column))
+          depths[offset] = center_depth;
+      }
+
+      columns.clear();
+      int num_samples = supersampling*supersampling;
+      for (int i = 0; i < num_samples; ++ i)
+      {
+        double sample_x = x+((i%supersampling)+0.5)/supersampling-0.5;
+        double sample_y = y+((i/supersampling)+0.5)/supersampling-0.5;
+        double ray_x = (sample_x-camera.cx)/camera.fx;
+        double ray_y = (sample_y-camera.cy)/camera.fy;
+        double depth = target.intersect(ray_x, ray_y);
+        if (depth <= 0)
+          continue;
+
+        double point[3] = {depth*ray_x, depth*ray_y, depth};
+        int column;
+        if (project(stripe_set, calibration, point, column))
+          columns.push_back(column);
+      }
+      reached[offset] = !columns.empty();
+
+      std::fill(intensities.begin(), intensities.end(), 0.0);
+      for (size_t i = 0, i_end = columns.size(); i < i_end; ++ i)
+        for (int j = 0; j < image_number; ++ j)
+          intensities[j] += stripe_set.getRow(j)[columns[i]]?(lit_level):(dark_level);
+
+      for (int j = 0; j < image_number; ++ j)
+        images[j].pixels[offset] = (unsigned char)(intensities[j]/num_samples+0.5);
+    }
+  }
+
+  return;
+}
+
+#endif /*SYNTHETIC_STRIPES_H_*/